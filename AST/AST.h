@@ -3,6 +3,8 @@
 
 #include "Common.h"
 #include "Ref.h"
+#include "Atom.h"
+#include "Arena.h"
 
 enum astNodeType_t {
 	AST_PROGRAM,
@@ -21,45 +23,169 @@ enum astNodeType_t {
 	AST_BREAK,
 	AST_RETURN,
 	AST_IF,
-	AST_WHILE
+	AST_WHILE,
+	// Fused forms, see Fuser
+	AST_ADD_ASSIGN_CONST,
+	AST_WHILE_VAR_NON_ZERO,
+	AST_NOT_SUB_CONST
+};
+
+class ASTNode;
+
+// Borrowed view of the children of a node
+struct childSpan_t {
+	ASTNode* const*		data;
+	size_t				size;
+
+	ASTNode* operator [] (size_t index) const {
+		assert(index < size);
+		return data[index];
+	}
+
+	ASTNode* const* begin() const {
+		return data;
+	}
+
+	ASTNode* const* end() const {
+		return data + size;
+	}
 };
 
 class ASTNode : public virtual RefObject {
 private:
 	typedef Ref<ASTNode> AstNodeRef;
+	template <typename T, typename... Args>
+	friend T* ASTNew(Arena* arena, Args&&... args);
 	astNodeType_t			type;
-	vector<AstNodeRef>		children;
+	Arena*					arena;
+	ASTNode**				children;
+	uint32_t				numChildren;
+	uint32_t				capacity;
+	ASTNode*				inlineChildren[2];
+private:
+	ASTNode(const ASTNode&) = delete;
+	ASTNode& operator = (const ASTNode&) = delete;
+	void _Release() {
+		// Arena nodes are never destructed, the arena frees them in bulk
+		if (arena != nullptr)
+			return;
+		// Children that die with this node are stripped of their own
+		// children before they are deleted, so a deep tree is freed
+		// without recursing through it
+		vector<ASTNode*> dead;
+		_Detach(dead);
+		while (!dead.empty()) {
+			ASTNode* node = dead.back();
+			dead.pop_back();
+			node->_Detach(dead);
+			delete node;
+		}
+	}
+	void _Detach(vector<ASTNode*>& dead) {
+		for (uint32_t i = 0; i < numChildren; ++i) {
+			if (RefDecrement(children[i]))
+				dead.push_back(children[i]);
+		}
+		if (children != inlineChildren)
+			delete[] children;
+		children = inlineChildren;
+		numChildren = 0;
+		capacity = 2;
+	}
 protected:
-	ASTNode() {
+	ASTNode(astNodeType_t tp, Arena* a) : type(tp), arena(a) {
+		children = inlineChildren;
+		numChildren = 0;
+		capacity = 2;
 	}
 	void _Attach(const AstNodeRef& child) {
 		assert(child != nullptr);
-		children.push_back(child);
+		if (numChildren == capacity)
+			Reserve(capacity * 2);
+		RefIncrement(child.get());
+		children[numChildren++] = child.get();
 	}
 public:
-	ASTNode(astNodeType_t tp) : type(tp) {
+	ASTNode(astNodeType_t tp) : ASTNode(tp, nullptr) {
 	}
 
 	virtual ~ASTNode() {
+		_Release();
 	}
 
 	astNodeType_t Type() const {
 		return type;
 	}
 
+	// Arena holding the node and its children, null for heap nodes
+	Arena* Memory() const {
+		return arena;
+	}
+
+	// Make room for n children up front, so arena nodes do not leave
+	// outgrown spans behind
+	void Reserve(size_t n) {
+		if (n <= capacity)
+			return;
+		ASTNode** span = (arena != nullptr) ?
+			(ASTNode**)arena->Allocate(n * sizeof(ASTNode*), alignof(ASTNode*)) :
+			new ASTNode*[n];
+		for (uint32_t i = 0; i < numChildren; ++i)
+			span[i] = children[i];
+		if (arena == nullptr && children != inlineChildren)
+			delete[] children;
+		children = span;
+		capacity = static_cast<uint32_t>(n);
+	}
+
 	void Clear() {
-		children.clear();
+		if (arena != nullptr) {
+			numChildren = 0;
+			return;
+		}
+		_Release();
 	}
 
 	size_t NumChildren() const {
-		return children.size();
+		return numChildren;
 	}
 
-	Ref<ASTNode> Child(size_t index) const {
+	// Borrowed, valid while this node holds the child
+	ASTNode* Child(size_t index) const {
+		assert(index < numChildren);
 		return children[index];
 	}
+
+	childSpan_t Children() const {
+		childSpan_t span = { children, numChildren };
+		return span;
+	}
+
+	// Swap in a rewritten child, used by passes that transform the tree
+	void ReplaceChild(size_t index, const Ref<ASTNode>& node) {
+		assert(index < numChildren);
+		assert(node != nullptr);
+		ASTNode* old = children[index];
+		RefIncrement(node.get());
+		children[index] = node.get();
+		if (RefDecrement(old))
+			delete old;
+	}
 };
 
+// Allocate a node in the arena, or on the heap when arena is null.
+// Arena nodes hold a pinned reference so that dropping the last Ref
+// never deletes them; their memory goes away with the arena.
+template <typename T, typename... Args>
+T* ASTNew(Arena* arena, Args&&... args) {
+	if (arena == nullptr)
+		return new T(std::forward<Args>(args)...);
+	T* node = new (arena->Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	static_cast<ASTNode*>(node)->arena = arena;
+	RefIncrement(node);
+	return node;
+}
+
 class ASTIntLiteral : public ASTNode {
 private:
 	int literal;
@@ -83,15 +209,39 @@ public:
 
 class ASTIdentifier : public ASTNode {
 private:
-	string name;
+	atom_t name;
+	int slot;
+	int globalSlot;
 public:
-	ASTIdentifier(string value) : ASTNode(AST_IDENTIFIER) {
+	ASTIdentifier(atom_t value) : ASTNode(AST_IDENTIFIER) {
 		name = value;
+		slot = -1;
+		globalSlot = -1;
 	}
 
-	string Name() const {
+	atom_t Atom() const {
 		return name;
 	}
+
+	const string& Name() const {
+		return AtomName(name);
+	}
+
+	// Set by the resolver
+	void Resolve(int frameSlot, int fallbackSlot) {
+		slot = frameSlot;
+		globalSlot = fallbackSlot;
+	}
+
+	// Slot in the frame of the enclosing function, -1 if unresolved
+	int Slot() const {
+		return slot;
+	}
+
+	// Slot in the global frame used while Slot() is undefined, or -1
+	int GlobalSlot() const {
+		return globalSlot;
+	}
 };
 
 class ASTAdd : public ASTNode {
@@ -143,12 +293,12 @@ public:
 		_Attach(stat);
 	}
 
-	inline Ref<ASTNode> Expression() const {
-		return Child(0).get();
+	inline ASTNode* Expression() const {
+		return Child(0);
 	}
 
-	inline Ref<ASTNode> Statement() const {
-		return Child(1).get();
+	inline ASTNode* Statement() const {
+		return Child(1);
 	}
 };
 
@@ -160,12 +310,12 @@ public:
 		_Attach(stat);
 	}
 
-	inline Ref<ASTNode> Expression() const {
-		return Child(0).get();
+	inline ASTNode* Expression() const {
+		return Child(0);
 	}
 
-	inline Ref<ASTNode> Statement() const {
-		return Child(1).get();
+	inline ASTNode* Statement() const {
+		return Child(1);
 	}
 };
 
@@ -192,11 +342,11 @@ public:
 		ASTAssign((ASTNode*)a.get(),b) {
 	}
 
-	inline Ref<ASTIdentifier> LHS() const {
-		return (ASTIdentifier*)Child(0).get();
+	inline ASTIdentifier* LHS() const {
+		return (ASTIdentifier*)Child(0);
 	}
 
-	inline Ref<ASTNode> RHS() const {
+	inline ASTNode* RHS() const {
 		return Child(1);
 	}
 };
@@ -207,26 +357,38 @@ public:
 		_Attach(a);
 	}
 
-	inline Ref<ASTNode> Expression() const {
-		return (ASTNode*)Child(0).get();
+	inline ASTNode* Expression() const {
+		return Child(0);
 	}
 };
 
 class ASTCall : public ASTNode {
+	int site;
 public:
 	ASTCall(Ref<ASTIdentifier> a) : ASTNode(AST_CALL) {
+		site = -1;
 		_Attach(a);
 	}
 
+	// Set by the resolver
+	void SetSite(int index) {
+		site = index;
+	}
+
+	// Index of the call among the calls of the program, -1 if unresolved
+	int Site() const {
+		return site;
+	}
+
 	void AttachChild(Ref<ASTNode> node) {
 		_Attach(node);
 	}
 
-	inline Ref<ASTIdentifier> Identifier() const {
-		return (ASTIdentifier*)Child(0).get();
+	inline ASTIdentifier* Identifier() const {
+		return (ASTIdentifier*)Child(0);
 	}
 
-	inline Ref<ASTNode> Argument(size_t index) const {
+	inline ASTNode* Argument(size_t index) const {
 		return Child(1 + index);
 	}
 
@@ -236,19 +398,34 @@ public:
 };
 
 class ASTParameter : public ASTNode {
-	string name;
+	atom_t name;
+	int slot;
 public:
-	ASTParameter(string value) : ASTNode(AST_PARAMETER) {
+	ASTParameter(atom_t value) : ASTNode(AST_PARAMETER) {
 		name = value;
+		slot = -1;
 	}
 
 	ASTParameter(Ref<ASTIdentifier> value) : ASTNode(AST_PARAMETER) {
-		name = value->Name();
+		name = value->Atom();
+		slot = -1;
 	}
 
-	string Name() const {
+	atom_t Atom() const {
 		return name;
 	}
+
+	const string& Name() const {
+		return AtomName(name);
+	}
+
+	void SetSlot(int s) {
+		slot = s;
+	}
+
+	int Slot() const {
+		return slot;
+	}
 };
 
 class ASTBreak : public ASTNode {
@@ -264,8 +441,8 @@ public:
 		_Attach(node);
 	}
 
-	inline Ref<ASTNode> Expression() const {
-		return Child(0).get();
+	inline ASTNode* Expression() const {
+		return Child(0);
 	}
 };
 
@@ -280,10 +457,12 @@ public:
 };
 
 class ASTFuncDef : public ASTNode {
-	string name;
+	atom_t name;
+	int numSlots;
 public:
-	ASTFuncDef(const string& value, const Ref<ASTBlock>& block) : ASTNode(AST_FUNC_DEF) {
+	ASTFuncDef(atom_t value, const Ref<ASTBlock>& block) : ASTNode(AST_FUNC_DEF) {
 		name = value;
+		numSlots = -1;
 		_Attach(block);
 	}
 
@@ -291,31 +470,154 @@ public:
 		_Attach(param);
 	}
 
-	string Name() const {
+	atom_t Atom() const {
 		return name;
 	}
 
-	inline Ref<ASTBlock> Block() const {
-		return (ASTBlock*)Child(0).get();
+	const string& Name() const {
+		return AtomName(name);
 	}
 
-	inline Ref<ASTParameter> Parameter(size_t index) const {
-		return (ASTParameter*)Child(1 + index).get();
+	inline ASTBlock* Block() const {
+		return (ASTBlock*)Child(0);
+	}
+
+	inline ASTParameter* Parameter(size_t index) const {
+		return (ASTParameter*)Child(1 + index);
 	}
 
 	inline size_t NumParameters() const {
 		return NumChildren() - 1;
 	}
+
+	// Frame size of a call, -1 if unresolved
+	void SetNumSlots(int n) {
+		numSlots = n;
+	}
+
+	int NumSlots() const {
+		return numSlots;
+	}
 };
 
 class ASTProgram : public ASTNode {
+	// Arenas of this program and of the programs appended to it
+	vector<ArenaRef> storage;
+	int numSlots;
+	int numCallSites;
 public:
-	ASTProgram() : ASTNode(AST_PROGRAM) {
+	// With an arena, every node of the program lives in it and
+	// releasing the program frees the whole tree at once
+	ASTProgram(Arena* a = nullptr) : ASTNode(AST_PROGRAM, a) {
+		if (a != nullptr)
+			storage.push_back(a);
+		numSlots = -1;
+		numCallSites = -1;
+	}
+
+	// Children go before the arenas they can live in
+	~ASTProgram() {
+		Clear();
 	}
 
 	void AttachChild(Ref<ASTNode> node) {
 		_Attach(node);
 	}
+
+	// Moves the statements of other to the end of this program and keeps
+	// the arenas they live in. The result has to be resolved again.
+	void Append(ASTProgram* other) {
+		assert(other != nullptr && other != this);
+		// An arena program never releases its children one by one
+		assert(Memory() == nullptr || other->Memory() != nullptr);
+		Reserve(NumChildren() + other->NumChildren());
+		for (ASTNode* child : other->Children())
+			_Attach(child);
+		for (size_t i = 0; i < other->storage.size(); ++i)
+			storage.push_back(other->storage[i]);
+		other->Clear();
+		numSlots = -1;
+		numCallSites = -1;
+	}
+
+	// Size of the global frame, -1 if unresolved
+	void SetNumSlots(int n) {
+		numSlots = n;
+	}
+
+	int NumSlots() const {
+		return numSlots;
+	}
+
+	// Number of resolved call sites, -1 if unresolved
+	void SetNumCallSites(int n) {
+		numCallSites = n;
+	}
+
+	int NumCallSites() const {
+		return numCallSites;
+	}
+};
+
+// x = x + k, or x = x - k with k negated
+class ASTAddAssignConst : public ASTNode {
+	int constant;
+public:
+	ASTAddAssignConst(Ref<ASTIdentifier> ident, int k) : ASTNode(AST_ADD_ASSIGN_CONST) {
+		constant = k;
+		_Attach(ident);
+	}
+
+	inline ASTIdentifier* Identifier() const {
+		return (ASTIdentifier*)Child(0);
+	}
+
+	int Constant() const {
+		return constant;
+	}
+};
+
+// while (x), while (x--) or while (x++), with a step of 0, -1 or 1
+class ASTWhileVarNonZero : public ASTNode {
+	int step;
+public:
+	ASTWhileVarNonZero(Ref<ASTIdentifier> ident, Ref<ASTNode> stat, int s) :
+		ASTNode(AST_WHILE_VAR_NON_ZERO) {
+		assert(s >= -1 && s <= 1);
+		step = s;
+		_Attach(ident);
+		_Attach(stat);
+	}
+
+	inline ASTIdentifier* Identifier() const {
+		return (ASTIdentifier*)Child(0);
+	}
+
+	inline ASTNode* Statement() const {
+		return Child(1);
+	}
+
+	int Step() const {
+		return step;
+	}
+};
+
+// !(x - k), which is 1 when x is k
+class ASTNotSubConst : public ASTNode {
+	int constant;
+public:
+	ASTNotSubConst(Ref<ASTIdentifier> ident, int k) : ASTNode(AST_NOT_SUB_CONST) {
+		constant = k;
+		_Attach(ident);
+	}
+
+	inline ASTIdentifier* Identifier() const {
+		return (ASTIdentifier*)Child(0);
+	}
+
+	int Constant() const {
+		return constant;
+	}
 };
 
 typedef Ref<ASTNode>		ASTNodeRef;
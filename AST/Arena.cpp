@@ -0,0 +1,43 @@
+#include "Arena.h"
+
+Arena::Arena(size_t size) {
+	head = nullptr;
+	remaining = 0;
+	chunkSize = size;
+	used = 0;
+}
+
+Arena::~Arena() {
+	for (size_t i = 0; i < chunks.size(); ++i)
+		delete[] chunks[i];
+}
+
+void Arena::_NewChunk(size_t minSize) {
+	size_t size = (minSize > chunkSize) ? minSize : chunkSize;
+	chunks.push_back(new char[size]);
+	head = chunks.back();
+	remaining = size;
+}
+
+void* Arena::Allocate(size_t size, size_t align) {
+	assert(align > 0 && (align & (align - 1)) == 0);
+	size_t pad = (align - (reinterpret_cast<uintptr_t>(head) & (align - 1))) & (align - 1);
+	if (head == nullptr || pad + size > remaining) {
+		_NewChunk(size + align);
+		pad = (align - (reinterpret_cast<uintptr_t>(head) & (align - 1))) & (align - 1);
+	}
+
+	char* ptr = head + pad;
+	head += pad + size;
+	remaining -= pad + size;
+	used += size;
+	return ptr;
+}
+
+size_t Arena::BytesUsed() const {
+	return used;
+}
+
+size_t Arena::NumChunks() const {
+	return chunks.size();
+}
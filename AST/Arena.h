@@ -0,0 +1,30 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include "Common.h"
+#include "Ref.h"
+#include <cstdint>
+
+// Bump allocator. Memory is only returned when the arena is destroyed,
+// and nothing allocated from it is ever destructed.
+class Arena : public virtual RefObject {
+private:
+	vector<char*>	chunks;
+	char*			head;
+	size_t			remaining;
+	size_t			chunkSize;
+	size_t			used;
+private:
+	void			_NewChunk(size_t minSize);
+public:
+					Arena(size_t chunkSize = 64 * 1024);
+					~Arena();
+
+	void*			Allocate(size_t size, size_t align);
+	size_t			BytesUsed() const;
+	size_t			NumChunks() const;
+};
+
+typedef Ref<Arena> ArenaRef;
+
+#endif // __ARENA_H__
@@ -0,0 +1,127 @@
+#include "Atom.h"
+#include "Dict.h"
+
+#include <atomic>
+#include <cstring>
+
+// A name this thread interned lately. Names do not change once added,
+// so the pointer can be compared against without the table's lock.
+struct atomCacheEntry_t {
+	uint32_t		table;
+	uint32_t		hash;
+	atom_t			atom;
+	const string*	name;
+};
+
+const size_t ATOM_CACHE_SIZE = 1024;
+
+static thread_local atomCacheEntry_t atomCache[ATOM_CACHE_SIZE];
+
+// Ids start at 1, as unused cache entries hold table 0
+static atomic<uint32_t> nextTableId(1);
+
+AtomTable::AtomTable() {
+	id = nextTableId.fetch_add(1);
+	// Atom 0 is the empty name
+	names.push_back("");
+	hashes.push_back(0);
+	table.resize(64, ATOM_NONE);
+}
+
+AtomTable::~AtomTable() {
+}
+
+size_t AtomTable::_Find(uint32_t hash, const char* str, size_t length) const {
+	size_t mask = table.size() - 1;
+	size_t i = hash & mask;
+	while (table[i] != ATOM_NONE) {
+		atom_t atom = table[i];
+		if (hashes[atom] == hash &&
+			names[atom].size() == length &&
+			memcmp(names[atom].data(), str, length) == 0) {
+			return i;
+		}
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+void AtomTable::_Grow() {
+	vector<atom_t> old(table.size() * 2, ATOM_NONE);
+	old.swap(table);
+
+	size_t mask = table.size() - 1;
+	for (size_t j = 0; j < old.size(); ++j) {
+		if (old[j] == ATOM_NONE)
+			continue;
+		size_t i = hashes[old[j]] & mask;
+		while (table[i] != ATOM_NONE)
+			i = (i + 1) & mask;
+		table[i] = old[j];
+	}
+}
+
+atom_t AtomTable::Intern(const char* str, size_t length) {
+	if (length == 0)
+		return ATOM_NONE;
+
+	// Lookups of known names do not allocate
+	uint32_t hash = DictHash(str, length);
+	atomCacheEntry_t& cached = atomCache[hash & (ATOM_CACHE_SIZE - 1)];
+	if (cached.table == id && cached.hash == hash &&
+		cached.name->size() == length &&
+		memcmp(cached.name->data(), str, length) == 0) {
+		return cached.atom;
+	}
+
+	lock_guard<mutex> guard(lock);
+	size_t i = _Find(hash, str, length);
+	atom_t atom = table[i];
+	if (atom == ATOM_NONE) {
+		atom = static_cast<atom_t>(names.size());
+		names.push_back(string(str, length));
+		hashes.push_back(hash);
+		table[i] = atom;
+
+		if (names.size() * 4 > table.size() * 3)
+			_Grow();
+	}
+
+	cached.table = id;
+	cached.hash = hash;
+	cached.atom = atom;
+	cached.name = &names[atom];
+	return atom;
+}
+
+atom_t AtomTable::Intern(const string& str) {
+	return Intern(str.data(), str.size());
+}
+
+const string& AtomTable::Name(atom_t atom) const {
+	lock_guard<mutex> guard(lock);
+	assert(atom < names.size());
+	return names[atom];
+}
+
+size_t AtomTable::Size() const {
+	lock_guard<mutex> guard(lock);
+	return names.size();
+}
+
+AtomTable& Atoms() {
+	static AtomTable atoms;
+	return atoms;
+}
+
+atom_t Intern(const char* str, size_t length) {
+	return Atoms().Intern(str, length);
+}
+
+atom_t Intern(const string& str) {
+	return Atoms().Intern(str);
+}
+
+const string& AtomName(atom_t atom) {
+	return Atoms().Name(atom);
+}
@@ -0,0 +1,46 @@
+#ifndef __ATOM_H__
+#define __ATOM_H__
+
+#include "Common.h"
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+// An interned name. Equal names have equal atoms.
+typedef uint32_t atom_t;
+
+const atom_t ATOM_NONE = 0;
+
+// Safe to use from several threads at once. Names are never removed, so
+// a reference to one stays valid after the lock is let go. Each thread
+// remembers the names it interned lately, and interning one of those
+// again takes no lock, so threads lexing at once do not queue on it.
+class AtomTable {
+private:
+	// Tells apart the tables a thread has remembered names of
+	uint32_t			id;
+	mutable mutex		lock;
+	// Deque so references to names survive growth
+	deque<string>		names;
+	vector<uint32_t>	hashes;
+	vector<atom_t>		table;
+private:
+	size_t				_Find(uint32_t hash, const char* str, size_t length) const;
+	void				_Grow();
+public:
+						AtomTable();
+						~AtomTable();
+
+	atom_t				Intern(const char* str, size_t length);
+	atom_t				Intern(const string& str);
+	const string&		Name(atom_t atom) const;
+	size_t				Size() const;
+};
+
+// Process wide table used by the lexer, parser and engine
+AtomTable&		Atoms();
+atom_t			Intern(const char* str, size_t length);
+atom_t			Intern(const string& str);
+const string&	AtomName(atom_t atom);
+
+#endif // __ATOM_H__
@@ -0,0 +1,63 @@
+#include "Bench.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+double BenchBest(int runs, const function<void()>& run) {
+	double best = 1e30;
+	for (int i = 0; i < runs; ++i) {
+		BenchTimer timer;
+		run();
+		double t = timer.Seconds();
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+string BenchFunction(const string& name, int k, const string& result) {
+	string text;
+	text += "function " + name + "(n) {\n";
+	text += "\tx = n + " + to_string(k) + ";\n";
+	text += "\twhile (x) { x--; if (!(x - 3)) break; }\n";
+	text += "\treturn " + result + ";\n";
+	text += "}\n";
+	return text;
+}
+
+#ifdef BENCH_ALLOCATIONS
+
+// Every heap allocation of the program goes through here so benchmarks
+// can report how many they cause. Only built in when asked for, as it
+// costs every allocation of the host an atomic increment.
+static atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+	allocations.fetch_add(1, memory_order_relaxed);
+	void* ptr = malloc(size > 0 ? size : 1);
+	if (ptr == nullptr)
+		throw bad_alloc();
+	return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	free(ptr);
+}
+
+bool BenchAllocations(size_t* count) {
+	*count = allocations.load(memory_order_relaxed);
+	return true;
+}
+
+#else
+
+bool BenchAllocations(size_t* count) {
+	*count = 0;
+	return false;
+}
+
+#endif // BENCH_ALLOCATIONS
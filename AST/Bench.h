@@ -0,0 +1,68 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include "Common.h"
+#include <chrono>
+#include <functional>
+
+// Benchmarks run by Main with -bench. Each prints its own results.
+
+class BenchTimer {
+private:
+	chrono::steady_clock::time_point start;
+public:
+	BenchTimer() {
+		start = chrono::steady_clock::now();
+	}
+
+	double Seconds() const {
+		return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+};
+
+// Fastest of runs calls of run, in seconds
+double BenchBest(int runs, const function<void()>& run);
+
+// function name(n) { x = n + k; while (x) { x--; if (!(x - 3)) break; }
+// return result; } over five lines, what most bench scripts are made of
+string BenchFunction(const string& name, int k, const string& result = "x");
+
+// Heap allocations made by the program so far. False when they are not
+// counted, which needs a build with BENCH_ALLOCATIONS defined.
+bool BenchAllocations(size_t* count);
+
+// Lexer throughput in MB/s of source, against the previous lexer
+void BenchLexer(const string& source);
+
+// Parse time of deeply nested assignments and calls, which should grow
+// linearly with the depth
+void BenchParserNesting();
+
+// Cost per node of walking a parsed tree through the borrowed child
+// accessors, against taking a Ref to every child
+void BenchTraversal();
+
+// Time and heap allocations per script function call
+void BenchCalls();
+
+// Scripts run per second by 1 to 64 threads, each with its own Engine,
+// all executing one shared Program
+void BenchThreads();
+
+// Jobs per second and latency percentiles of the Executor, from 1 to 8
+// workers
+void BenchExecutor();
+
+// Time to parse and link a batch of scripts with 1 to 16 jobs, and the
+// speedup over one
+void BenchLinker();
+
+// Start up time of a large script from a bytecode cache, against parsing
+// and compiling the text
+void BenchCache();
+
+// Time to read and lex a large script file mapped in place, against
+// reading it into a string and copying that into the Source
+void BenchSource();
+
+#endif // __BENCH_H__
@@ -0,0 +1,67 @@
+#include "Bench.h"
+#include "Parser.h"
+
+// Functions of mixed statements, each with a few dozen nodes
+static string TraversalSource(int functions) {
+	string text;
+	for (int i = 0; i < functions; ++i)
+		text += BenchFunction("f" + to_string(i), i, "g(n, x - 2) + h(x + n - b)");
+	return text;
+}
+
+// Children read through the borrowed accessors
+static size_t WalkBorrowed(ASTNode* root, vector<ASTNode*>& stack) {
+	size_t count = 0;
+	stack.push_back(root);
+	while (!stack.empty()) {
+		ASTNode* node = stack.back();
+		stack.pop_back();
+		count += node->Type() + 1;
+		for (ASTNode* child : node->Children())
+			stack.push_back(child);
+	}
+	return count;
+}
+
+// Children read as a Ref<ASTNode> copy each, the cost of returning by value
+static size_t WalkCounted(ASTNode* root, vector<ASTNode*>& stack) {
+	size_t count = 0;
+	stack.push_back(root);
+	while (!stack.empty()) {
+		ASTNode* node = stack.back();
+		stack.pop_back();
+		count += node->Type() + 1;
+		for (size_t i = 0; i < node->NumChildren(); ++i) {
+			Ref<ASTNode> child = node->Child(i);
+			stack.push_back(child.get());
+		}
+	}
+	return count;
+}
+
+void BenchTraversal() {
+	Parser parser(TraversalSource(2000).c_str());
+	parseResult_t result = parser.Parse();
+	assert(!parser.HasError());
+
+	vector<ASTNode*> stack;
+	size_t nodes = 0;
+	stack.push_back(result.ast.get());
+	while (!stack.empty()) {
+		ASTNode* node = stack.back();
+		stack.pop_back();
+		nodes++;
+		for (ASTNode* child : node->Children())
+			stack.push_back(child);
+	}
+
+	const int runs = 50;
+	size_t check = 0;
+	double borrowed = BenchBest(runs, [&]() { check += WalkBorrowed(result.ast.get(), stack); });
+	double counted = BenchBest(runs, [&]() { check -= WalkCounted(result.ast.get(), stack); });
+	assert(check == 0);
+
+	printf("ast traversal, %d nodes:\n", (int)nodes);
+	printf("  borrowed   %8.2f ns/node\n", borrowed * 1e9 / nodes);
+	printf("  ref copies %8.2f ns/node\n", counted * 1e9 / nodes);
+}
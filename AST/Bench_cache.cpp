@@ -0,0 +1,78 @@
+#include "Bench.h"
+#include "Parser.h"
+#include "Compiler.h"
+#include "Engine.h"
+#include "BytecodeCache.h"
+
+// A script of many small functions, the last of which calls the rest
+static string CacheSource(int functions) {
+	string text;
+	for (int i = 0; i < functions; ++i)
+		text += BenchFunction("f" + to_string(i), i);
+	text += "function all(n) {\n";
+	for (int i = 0; i < functions; ++i)
+		text += "\tn = f" + to_string(i) + "(n);\n";
+	text += "\treturn n;\n}\n";
+	return text;
+}
+
+void BenchCache() {
+	const int functions = 20000;
+	const char* fileName = "bench.wirec";
+	string text = CacheSource(functions);
+	SourceRef source = new Source(text.data(), text.size());
+
+	const int runs = 5;
+	BytecodeProgramRef compiled;
+	double parse = BenchBest(runs, [&]() {
+		Parser parser(text.c_str());
+		parseResult_t result = parser.Parse();
+		assert(!parser.HasError());
+		Compiler compiler;
+		compiled = compiler.Compile(result.ast.get());
+	});
+
+	BytecodeCache cache;
+	if (!cache.Save(fileName, compiled.get(), source.get())) {
+		printf("cache: skipped, %s\n", cache.Error().c_str());
+		return;
+	}
+
+	// The first load after the save, then the best of the loads after it
+	BenchTimer timer;
+	BytecodeProgramRef loaded = cache.Load(fileName, source.get());
+	double first = timer.Seconds();
+	bool failed = loaded == nullptr;
+	double load = BenchBest(runs, [&]() {
+		loaded = nullptr;
+		loaded = cache.Load(fileName, source.get());
+		failed = failed || loaded == nullptr;
+	});
+	if (failed) {
+		printf("cache: skipped, %s\n", cache.Error().c_str());
+		remove(fileName);
+		return;
+	}
+
+	// Both run alike
+	Engine engine;
+	ProgramRef program = engine.Load(loaded.get());
+	bool same = false;
+	if (program != nullptr) {
+		object_t arg = IntegerObject(5);
+		argSpan_t args = { &arg, 1 };
+		object_t result = engine.Call(program.get(), "all", args);
+		same = !engine.HasError() && result.value._int == 3;
+	}
+
+	loaded = nullptr;
+	remove(fileName);
+
+	printf("cache, %d functions, %.1f MB:\n", functions, text.size() / 1e6);
+	printf("  %-24s %10.2f ms\n", "parse and compile", parse * 1e3);
+	printf("  %-24s %10.2f ms\n", "first load", first * 1e3);
+	printf("  %-24s %10.2f ms\n", "warm load", load * 1e3);
+	printf("  %-24s %10.2f\n", "first load speedup", parse / first);
+	printf("  %-24s %10.2f\n", "warm load speedup", parse / load);
+	printf("  %-24s %10s\n", "result", same ? "ok" : "WRONG");
+}
@@ -0,0 +1,49 @@
+#include "Bench.h"
+#include "Parser.h"
+#include "Engine.h"
+
+// A loop calling a small function. Each iteration also enters the block
+// of the loop and the block of the function.
+static const char* callSource =
+	"function leaf(a, b) {\n"
+	"	c = a + b;\n"
+	"	return c;\n"
+	"}\n"
+	"i = 200000;\n"
+	"while (i) {\n"
+	"	leaf(i, 1);\n"
+	"	i--;\n"
+	"}\n";
+
+static const int numCalls = 200000;
+
+void BenchCalls() {
+	Parser parser(callSource);
+	parseResult_t result = parser.Parse();
+	assert(!parser.HasError());
+
+	printf("calls: %d\n", numCalls);
+	printf("  %-10s %12s %12s\n", "mode", "ns/call", "allocs/call");
+
+	executionMode_t modes[] = { EXEC_AST, EXEC_BYTECODE, EXEC_FLAT };
+	const char* names[] = { "ast", "bytecode", "flat" };
+	for (int i = 0; i < 3; ++i) {
+		Engine engine;
+		engine.SetExecutionMode(modes[i]);
+
+		size_t before = 0;
+		size_t after = 0;
+		bool counted = BenchAllocations(&before);
+		BenchTimer timer;
+		engine.Execute(result.ast.get());
+		double t = timer.Seconds();
+		BenchAllocations(&after);
+
+		if (counted) {
+			printf("  %-10s %12.1f %12.2f\n", names[i],
+				t * 1e9 / numCalls, (double)(after - before) / numCalls);
+		} else {
+			printf("  %-10s %12.1f %12s\n", names[i], t * 1e9 / numCalls, "-");
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#include "Bench.h"
+#include "Parser.h"
+#include "Executor.h"
+#include <algorithm>
+
+// Each job loops a little and reports when it is done
+static const char* jobSource =
+	"function work(n) {\n"
+	"	x = 0;\n"
+	"	while (n) {\n"
+	"		x = x + 1;\n"
+	"		n--;\n"
+	"	}\n"
+	"	return x;\n"
+	"}\n"
+	"function job(i) {\n"
+	"	work(200);\n"
+	"	done(i);\n"
+	"	return i;\n"
+	"}\n";
+
+static const int numJobs = 20000;
+
+static vector<chrono::steady_clock::time_point> finished(numJobs);
+
+// Each job writes its own entry, read after its future is ready
+static bool Done(const argSpan_t& args, object_t*, callbackFailure_t*) {
+	finished[args[0].value._int] = chrono::steady_clock::now();
+	return true;
+}
+
+void BenchExecutor() {
+	Parser parser(jobSource);
+	parseResult_t result = parser.Parse();
+	assert(!parser.HasError());
+
+	Engine loader;
+	loader.DefineCallback("done", 1, Done);
+	ProgramRef program = loader.Load(result.ast.get());
+	atom_t job = Intern("job");
+
+	printf("executor, %d jobs:\n", numJobs);
+	printf("  %8s %12s %10s %10s\n", "workers", "jobs/s", "p50 us", "p99 us");
+
+	vector<chrono::steady_clock::time_point> submitted(numJobs);
+	vector<future<jobResult_t>> futures(numJobs);
+	vector<double> latencies(numJobs);
+	int wrong = 0;
+
+	for (size_t n = 1; n <= 8; n *= 2) {
+		Executor executor(n);
+
+		// Throughput, with every job queued at once
+		BenchTimer timer;
+		for (int i = 0; i < numJobs; ++i)
+			futures[i] = executor.Submit(program.get(), job, vector<object_t>(1, IntegerObject(i)));
+		for (int i = 0; i < numJobs; ++i) {
+			jobResult_t r = futures[i].get();
+			if (r.error.code != RT_ERR_NONE || r.value.value._int != i)
+				wrong++;
+		}
+		double rate = numJobs / timer.Seconds();
+
+		// Latency, with a few jobs per worker in flight at a time
+		size_t wave = 4 * n;
+		for (size_t first = 0; first < (size_t)numJobs; first += wave) {
+			size_t end = min(first + wave, (size_t)numJobs);
+			for (size_t i = first; i < end; ++i) {
+				submitted[i] = chrono::steady_clock::now();
+				futures[i] = executor.Submit(program.get(), job, vector<object_t>(1, IntegerObject((int)i)));
+			}
+			for (size_t i = first; i < end; ++i)
+				futures[i].wait();
+		}
+		for (int i = 0; i < numJobs; ++i)
+			latencies[i] = chrono::duration<double, micro>(finished[i] - submitted[i]).count();
+		sort(latencies.begin(), latencies.end());
+
+		printf("  %8d %12.0f %10.1f %10.1f\n", (int)n, rate,
+			latencies[numJobs / 2], latencies[numJobs * 99 / 100]);
+	}
+
+	if (wrong != 0)
+		printf("  %d jobs went wrong\n", wrong);
+}
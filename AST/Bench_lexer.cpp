@@ -0,0 +1,442 @@
+#include "Bench.h"
+#include "Lexer.h"
+#include "Char.h"
+#include <cstring>
+
+// The lexer as it was before the single-pass rewrite, kept as the
+// baseline for the throughput comparison. Every token kind is tried in
+// turn, restoring the head between attempts.
+struct retryTok_t {
+	tokenType_t	type;
+	string		value;
+	atom_t		atom;
+};
+
+class RetryLexer {
+private:
+	int			head;
+	char		look;
+	string		value;
+	const char* input;
+	int			inputLength;
+	int			line;
+	retryTok_t	tok;
+private:
+	void		_ClearToken();
+	void		_Push(char c);
+	void		_Pop();
+	void		_Clear();
+public:
+				RetryLexer(const char* input);
+				~RetryLexer();
+
+	int			Line() const;
+	int			Head() const;
+	retryTok_t	Token() const;
+	void		AdvanceToken();
+	void		Advance();
+	void		Restore(int where);
+	void		Restore(int where, retryTok_t reset);
+
+	bool		MatchAlpha();
+	bool		MatchAlphaNum();
+	bool		MatchWhite();
+	bool		MatchVerticalWhite();
+	bool		MatchDecimalDigit();
+	bool		MatchDecimalInteger();
+	bool		MatchIdentifier();
+	bool		Match(const char* str);
+	bool		MatchKeyword(const char* str);
+	bool		Match(char c);
+	bool		MatchLineComment();
+};
+
+RetryLexer::RetryLexer(const char * inp) : input(inp) {
+	assert(input != nullptr);
+	inputLength = static_cast<int>(strlen(input));
+	line = 0;
+	value.clear();
+	tok.type = TOK_EOF;
+	tok.atom = ATOM_NONE;
+	head = -1;
+	Advance();
+}
+
+RetryLexer::~RetryLexer() {
+}
+
+void RetryLexer::_ClearToken() {
+	tok.type = TOK_EOF;
+	tok.value.clear();
+	tok.atom = ATOM_NONE;
+}
+
+void RetryLexer::_Push(char c) {
+	value.push_back(c);
+}
+
+void RetryLexer::_Pop() {
+	if (value.size() > 0)
+		value.pop_back();
+}
+
+void RetryLexer::_Clear() {
+	value.clear();
+}
+
+int RetryLexer::Line() const {
+	return line;
+}
+
+int RetryLexer::Head() const {
+	return head;
+}
+
+retryTok_t RetryLexer::Token() const {
+	return tok;
+}
+
+void RetryLexer::Restore(int where) {
+	while (head > where) {
+		_Pop();
+		head--;
+		look = input[head];
+		if (IsVerticalWhite(look)) {
+			line--;
+		}
+	}
+	assert(head == where);
+	assert(look == input[head]);
+}
+
+void RetryLexer::Restore(int where, retryTok_t reset) {
+	Restore(where);
+	tok = reset;
+}
+
+void RetryLexer::Advance() {
+	if (head < inputLength) {
+		_Push(look);
+		if (IsVerticalWhite(look)) {
+			line++;
+		}
+		head++;
+		look = input[head];
+	}
+}
+
+bool RetryLexer::Match(char c) {
+	if (look == c) {
+		Advance();
+		return true;
+	}
+	return false;
+}
+
+bool RetryLexer::MatchAlpha() {
+	if (IsAlpha(look)) {
+		Advance();
+		return true;
+	}
+	return false;
+}
+
+bool RetryLexer::MatchAlphaNum() {
+	if (IsAlphaNumeric(look)) {
+		Advance();
+		return true;
+	}
+	return false;
+}
+
+bool RetryLexer::MatchWhite() {
+	if (IsWhite(look)) {
+		Advance();
+		return true;
+	}
+	return false;
+}
+
+bool RetryLexer::MatchVerticalWhite() {
+	if (IsVerticalWhite(look)) {
+		Advance();
+		return true;
+	}
+	return false;
+}
+
+bool RetryLexer::MatchDecimalDigit() {
+	if (IsDigit(look)) {
+		Advance();
+		return true;
+	}
+	return false;
+}
+
+bool RetryLexer::MatchDecimalInteger() {
+	if (MatchDecimalDigit()) {
+		while (MatchDecimalDigit()) {
+		}
+		return true;
+	}
+	return false;
+}
+
+bool RetryLexer::MatchIdentifier() {
+	if (!MatchAlpha())
+		return false;
+
+	while (
+		MatchAlphaNum() ||
+		Match('_')) {
+	}
+
+	return true;
+}
+
+bool RetryLexer::Match(const char* str) {
+	int len = static_cast<int>(strlen(str));
+	for (int i = 0; i < len; ++i) {
+		if (!Match(str[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RetryLexer::MatchKeyword(const char* str) {
+	if (!Match(str))
+		return false;
+
+	if (IsAlphaNumeric(look)) {
+		return false;
+	}
+
+	return true;
+}
+
+bool RetryLexer::MatchLineComment() {
+	if (Match("//")) {
+		while (!MatchVerticalWhite()) {
+			Advance();
+		}
+		return true;
+	}
+	return false;
+}
+
+void RetryLexer::AdvanceToken() {
+
+	do {
+		while (MatchLineComment()) {}
+	} while (MatchWhite());
+
+	_Clear();
+	tok.atom = ATOM_NONE;
+
+	int tmp = head;
+
+	if (head >= inputLength) {
+		tok.type = TOK_EOF;
+		return;
+	}
+
+	Restore(tmp);
+	if (Match('!')) {
+		tok.type = TOK_BANG;
+		tok.value = value;
+		assert(tok.value == "!");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match("++")) {
+		tok.type = TOK_INCREMENT;
+		tok.value = value;
+		assert(tok.value == "++");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match("--")) {
+		tok.type = TOK_DECREMENT;
+		tok.value = value;
+		assert(tok.value == "--");
+		return;
+	}
+
+	Restore(tmp);
+	if (MatchKeyword("if")) {
+		tok.type = TOK_IF;
+		tok.value = value;
+		assert(tok.value == "if");
+		return;
+	}
+
+	Restore(tmp);
+	if (MatchKeyword("while")) {
+		tok.type = TOK_WHILE;
+		tok.value = value;
+		assert(tok.value == "while");
+		return;
+	}
+
+	Restore(tmp);
+	if (MatchKeyword("function")) {
+		tok.type = TOK_FUNCTION;
+		tok.value = value;
+		assert(tok.value == "function");
+		return;
+	}
+
+	Restore(tmp);
+	if (MatchKeyword("return")) {
+		tok.type = TOK_RETURN;
+		tok.value = value;
+		assert(tok.value == "return");
+		return;
+	}
+
+	Restore(tmp);
+	if (MatchKeyword("break")) {
+		tok.type = TOK_BREAK;
+		tok.value = value;
+		assert(tok.value == "break");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match('+')) {
+		tok.type = TOK_PLUS;
+		tok.value = value;
+		assert(tok.value == "+");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match('-')) {
+		tok.type = TOK_MINUS;
+		tok.value = value;
+		assert(tok.value == "-");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match('=')) {
+		tok.type = TOK_ASSIGN;
+		tok.value = value;
+		assert(tok.value == "=");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match(';')) {
+		tok.type = TOK_TERMINATOR;
+		tok.value = value;
+		assert(tok.value == ";");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match(',')) {
+		tok.type = TOK_COMMA;
+		tok.value = value;
+		assert(tok.value == ",");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match('(')) {
+		tok.type = TOK_LPAREN;
+		tok.value = value;
+		assert(tok.value == "(");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match(')')) {
+		tok.type = TOK_RPAREN;
+		tok.value = value;
+		assert(tok.value == ")");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match('{')) {
+		tok.type = TOK_LBRACE;
+		tok.value = value;
+		assert(tok.value == "{");
+		return;
+	}
+
+	Restore(tmp);
+	if (Match('}')) {
+		tok.type = TOK_RBRACE;
+		tok.value = value;
+		assert(tok.value == "}");
+		return;
+	}
+
+
+	Restore(tmp);
+	if (MatchDecimalInteger()) {
+		tok.type = TOK_DECIMAL_INTEGER;
+		tok.value = value;
+		assert(IsDigit(tok.value[0]));
+		return;
+	}
+
+	Restore(tmp);
+	if (MatchIdentifier()) {
+		tok.type = TOK_IDENTIFIER;
+		tok.value = value;
+		tok.atom = Intern(value);
+		assert(IsAlpha(tok.value[0]));
+		return;
+	}
+}
+
+static size_t LexSinglePass(const SourceRef& source) {
+	Lexer lexer(source);
+	size_t count = 0;
+	do {
+		lexer.AdvanceToken();
+		count++;
+	} while (lexer.Token().type != TOK_EOF);
+	return count;
+}
+
+static size_t LexRetry(const string& source) {
+	RetryLexer lexer(source.c_str());
+	lexer.Restore(0);
+	size_t count = 0;
+	do {
+		lexer.AdvanceToken();
+		count++;
+	} while (lexer.Token().type != TOK_EOF);
+	return count;
+}
+
+void BenchLexer(const string& source) {
+	// Repeat the source to get a corpus big enough to time
+	string corpus;
+	while (corpus.size() < 4 * 1024 * 1024) {
+		corpus += source;
+		corpus += "\n";
+	}
+
+	SourceRef text = new Source(corpus.data(), corpus.size());
+	const int runs = 5;
+	double best[2];
+	size_t tokens[2] = { 0, 0 };
+	best[0] = BenchBest(runs, [&]() { tokens[0] = LexSinglePass(text); });
+	best[1] = BenchBest(runs, [&]() { tokens[1] = LexRetry(corpus); });
+
+	double megabytes = corpus.size() / (1024.0 * 1024.0);
+	printf("lexer: %.1f MB, %d tokens\n", megabytes, (int)tokens[0]);
+	printf("  single pass   %8.1f MB/s\n", megabytes / best[0]);
+	printf("  retry         %8.1f MB/s\n", megabytes / best[1]);
+	printf("  speedup       %8.1fx\n", best[1] / best[0]);
+	if (tokens[0] != tokens[1])
+		printf("  token counts differ (%d vs %d)\n", (int)tokens[0], (int)tokens[1]);
+}
@@ -0,0 +1,44 @@
+#include "Bench.h"
+#include "Linker.h"
+#include <thread>
+
+// Script number file of a batch. Every file calls into the next one, so
+// the batch only runs once it is linked.
+static string LinkerSource(int file, int functions) {
+	string text;
+	string next = "g" + to_string(file + 1) + "(x)";
+	for (int i = 0; i < functions; ++i)
+		text += BenchFunction("f" + to_string(file) + "_" + to_string(i), i, next);
+	text += "function g" + to_string(file) + "(n) {\n\treturn n;\n}\n";
+	return text;
+}
+
+void BenchLinker() {
+	const int numFiles = 256;
+	const int functions = 40;
+	vector<SourceRef> sources;
+	size_t bytes = 0;
+	for (int i = 0; i < numFiles; ++i) {
+		string text = LinkerSource(i, functions);
+		bytes += text.size();
+		sources.push_back(new Source(text.c_str()));
+	}
+
+	printf("linker, %d files, %.1f MB, %u hardware threads:\n", numFiles, bytes / 1e6,
+		thread::hardware_concurrency());
+	printf("  %8s %12s %10s\n", "jobs", "ms", "speedup");
+
+	double single = 0.0;
+	for (size_t jobs = 1; jobs <= 16; jobs *= 2) {
+		double best = BenchBest(3, [&]() {
+			Linker linker;
+			linker.SetJobs(jobs);
+			linkResult_t result = linker.Link(sources);
+			assert(!linker.HasError());
+		});
+		if (jobs == 1)
+			single = best;
+
+		printf("  %8d %12.2f %10.2f\n", (int)jobs, best * 1e3, single / best);
+	}
+}
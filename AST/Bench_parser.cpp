@@ -0,0 +1,35 @@
+#include "Bench.h"
+#include "Parser.h"
+
+// a0 = a1 = ... = f0(f1(...(x))); nested depth deep on both sides
+static string NestedSource(int depth) {
+	string text;
+	for (int i = 0; i < depth; ++i)
+		text += "a" + to_string(i) + " = ";
+	for (int i = 0; i < depth; ++i)
+		text += "f" + to_string(i) + "(";
+	text += "x";
+	for (int i = 0; i < depth; ++i)
+		text += ")";
+	text += ";\n";
+	return text;
+}
+
+void BenchParserNesting() {
+	printf("parser nesting:\n");
+	printf("  %8s %10s %12s %12s\n", "depth", "tokens", "ms", "ns/token");
+	for (int depth = 2; depth <= 1024; depth *= 2) {
+		SourceRef source = new Source(NestedSource(depth).c_str());
+		size_t tokens = 5 * depth + 2;
+
+		double best = BenchBest(5, [&]() {
+			Parser parser(source);
+			parser.SetMaxDepth(4 * depth);
+			parseResult_t result = parser.Parse();
+			assert(!parser.HasError());
+		});
+
+		printf("  %8d %10d %12.3f %12.1f\n", depth, (int)tokens,
+			best * 1e3, best * 1e9 / tokens);
+	}
+}
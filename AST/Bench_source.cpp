@@ -0,0 +1,56 @@
+#include "Bench.h"
+#include "Lexer.h"
+#include "MappedFile.h"
+
+// How a script was read before sources were mapped: the whole file into
+// a string, then copied again into the Source
+static SourceRef ReadCopy(const char* fileName) {
+	string text;
+	FILE* p = OpenFile(fileName, "rb");
+	if (p == nullptr)
+		return nullptr;
+	fseek(p, 0, SEEK_END);
+	long size = ftell(p);
+	fseek(p, 0, SEEK_SET);
+	if (size > 0) {
+		text.resize(size);
+		text.resize(fread(&text[0], 1, size, p));
+	}
+	fclose(p);
+	return new Source(text.c_str());
+}
+
+static size_t Lex(const SourceRef& source) {
+	Lexer lexer(source);
+	size_t count = 0;
+	do {
+		lexer.AdvanceToken();
+		count++;
+	} while (lexer.Token().type != TOK_EOF);
+	return count;
+}
+
+void BenchSource() {
+	const char* fileName = "bench.wire";
+	string chunk = BenchFunction("step", 1) + "// next\n";
+	size_t size = 0;
+	FILE* p = OpenFile(fileName, "wb");
+	assert(p != nullptr);
+	while (size < 32 * 1024 * 1024)
+		size += fwrite(chunk.data(), 1, chunk.size(), p);
+	fclose(p);
+
+	const int runs = 5;
+	double best[2];
+	size_t tokens[2] = { 0, 0 };
+	best[0] = BenchBest(runs, [&]() { tokens[0] = Lex(ReadCopy(fileName)); });
+	best[1] = BenchBest(runs, [&]() { tokens[1] = Lex(ReadSource(fileName)); });
+	remove(fileName);
+
+	double megabytes = size / (1024.0 * 1024.0);
+	printf("source, read and lex %.1f MB, %d tokens:\n", megabytes, (int)tokens[1]);
+	printf("  %-8s %10.2f ms %8.1f MB copied\n", "copied", best[0] * 1e3, 2 * megabytes);
+	printf("  %-8s %10.2f ms %8.1f MB copied\n", "mapped", best[1] * 1e3, 0.0);
+	printf("  %-8s %10.2f%s\n", "speedup", best[0] / best[1],
+		tokens[0] == tokens[1] ? "" : ", token counts differ");
+}
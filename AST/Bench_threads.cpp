@@ -0,0 +1,77 @@
+#include "Bench.h"
+#include "Parser.h"
+#include "Engine.h"
+#include <atomic>
+#include <thread>
+
+// A short script of the kind a host runs thousands of times a second
+static const char* threadSource =
+	"function step(n) {\n"
+	"	return n + 1;\n"
+	"}\n"
+	"function count(n) {\n"
+	"	x = 0;\n"
+	"	while (n) {\n"
+	"		x = step(x);\n"
+	"		n--;\n"
+	"	}\n"
+	"	return x;\n"
+	"}\n"
+	"check(count(1000));\n";
+
+static const int runsPerThread = 200;
+
+static atomic<int> wrongResults(0);
+
+static bool Check(const argSpan_t& args, object_t*, callbackFailure_t*) {
+	if (args[0].value._int != 1000)
+		wrongResults.fetch_add(1);
+	return true;
+}
+
+// Every thread has its own Engine and runs the one shared Program
+static void RunScripts(const Program* program) {
+	Engine engine;
+	for (int i = 0; i < runsPerThread; ++i) {
+		engine.Execute(program);
+		if (engine.HasError())
+			wrongResults.fetch_add(1);
+	}
+}
+
+void BenchThreads() {
+	Parser parser(threadSource);
+	parseResult_t result = parser.Parse();
+	assert(!parser.HasError());
+
+	printf("threads, %d runs each, %u hardware threads:\n", runsPerThread,
+		thread::hardware_concurrency());
+	printf("  %-10s %8s %12s %10s\n", "mode", "threads", "runs/s", "speedup");
+
+	executionMode_t modes[] = { EXEC_AST, EXEC_BYTECODE, EXEC_FLAT };
+	const char* names[] = { "ast", "bytecode", "flat" };
+	for (int m = 0; m < 3; ++m) {
+		Engine loader;
+		loader.SetExecutionMode(modes[m]);
+		loader.DefineCallback("check", 1, Check);
+		ProgramRef program = loader.Load(result.ast.get());
+
+		double single = 0.0;
+		for (int n = 1; n <= 64; n *= 2) {
+			vector<thread> threads;
+			BenchTimer timer;
+			for (int i = 0; i < n; ++i)
+				threads.push_back(thread(RunScripts, program.get()));
+			for (size_t i = 0; i < threads.size(); ++i)
+				threads[i].join();
+			double rate = n * runsPerThread / timer.Seconds();
+			if (n == 1)
+				single = rate;
+
+			printf("  %-10s %8d %12.0f %10.2f\n", names[m], n, rate, rate / single);
+		}
+	}
+
+	if (wrongResults.load() != 0)
+		printf("  %d runs went wrong\n", wrongResults.load());
+}
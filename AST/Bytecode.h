@@ -0,0 +1,94 @@
+#ifndef __BYTECODE_H__
+#define __BYTECODE_H__
+
+#include "Common.h"
+#include "Ref.h"
+#include "Atom.h"
+#include "MappedFile.h"
+
+// Register machine. Unless noted otherwise operands name registers
+// relative to the base of the current frame. var(s, g) is the variable
+// held in slot s, falling back to global slot g when s is undefined.
+enum opcode_t {
+	OP_NOP,
+	OP_NULL,		// R[a] = null
+	OP_INT,			// R[a] = b
+	OP_MOVE,		// R[a] = R[b]
+	OP_GETVAR,		// R[a] = var(b, c)
+	OP_SETVAR,		// var(a, c) = R[b]
+	OP_INCVAR,		// R[a] = ++var(b, c)
+	OP_DECVAR,		// R[a] = --var(b, c)
+	OP_INC,			// R[a]++
+	OP_DEC,			// R[a]--
+	OP_ADD,			// R[a] = R[b] + R[c]
+	OP_SUB,			// R[a] = R[b] - R[c]
+	OP_NOT,			// R[a] = !R[b]
+	OP_ENTER,		// R[a] = scope mark
+	OP_LEAVE,		// Undefine variables defined since mark R[a]
+	OP_JMP,			// pc = b
+	OP_JMPZ,		// if (!R[a]) pc = b
+	OP_CALL,		// R[a] = call site b, arguments in R[c...]
+	OP_CALLNATIVE,	// R[a] = callback site b, arguments in R[c...]
+	OP_TAILCALL,	// Return call site b, reusing the frame, arguments in R[c...]
+	OP_RET,			// Return R[a]
+	OP_BREAK,		// Return R[a] and break the loop the caller is in
+	OP_JMPBRK,		// If a call broke: b < 0 returns R[a] still breaking,
+					// otherwise leave mark R[c] unless c < 0 and pc = b
+	NUM_OP
+};
+
+struct instruction_t {
+	opcode_t		op;
+	int				a;
+	int				b;
+	int				c;
+};
+
+struct callSite_t {
+	atom_t			name;
+	int				function;
+	size_t			numArguments;
+};
+
+struct bytecodeFunction_t {
+	string					name;
+	size_t					numParameters;
+	size_t					numSlots;
+	size_t					numRegisters;
+	// What the VM runs, code as compiled or the function's part of a
+	// mapped cache file
+	const instruction_t*	instructions;
+	size_t					numInstructions;
+	vector<instruction_t>	code;
+};
+
+class BytecodeProgram : public virtual RefObject {
+private:
+	friend class Compiler;
+	friend class BytecodeCache;
+	vector<bytecodeFunction_t>	functions;
+	vector<callSite_t>			callSites;
+	// Holds the instructions of a program loaded from a cache file
+	MappedFileRef				storage;
+public:
+	// Function 0 holds the top level statements
+	size_t						NumFunctions() const {
+		return functions.size();
+	}
+
+	const bytecodeFunction_t&	Function(size_t index) const {
+		return functions[index];
+	}
+
+	size_t						NumCallSites() const {
+		return callSites.size();
+	}
+
+	const callSite_t&			CallSite(size_t index) const {
+		return callSites[index];
+	}
+};
+
+typedef Ref<BytecodeProgram> BytecodeProgramRef;
+
+#endif // __BYTECODE_H__
@@ -0,0 +1,444 @@
+#include "BytecodeCache.h"
+#include "Dict.h"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char CACHE_MAGIC[4] = { 'W', 'I', 'R', 'B' };
+static const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+// Word offsets of the header fields
+enum cacheHeader_t {
+	CH_MAGIC,
+	CH_VERSION,
+	CH_BYTE_ORDER,
+	CH_INSTRUCTION_SIZE,
+	CH_HASH_LOW,
+	CH_HASH_HIGH,
+	CH_SOURCE_LENGTH,
+	CH_NUM_NAMES,
+	CH_NUM_FUNCTIONS,
+	CH_NUM_CALL_SITES,
+	CH_SIZE
+};
+
+// Words of each function and call site record
+const size_t CACHE_FUNCTION_WORDS = 6;
+const size_t CACHE_CALL_SITE_WORDS = 3;
+
+// Far more than a compiled function uses, so a damaged count cannot size
+// the register file
+const size_t CACHE_MAX_REGISTERS = 1 << 20;
+
+static void PutWord(vector<char>& buffer, uint32_t word) {
+	const char* p = (const char*)&word;
+	buffer.insert(buffer.end(), p, p + sizeof(word));
+}
+
+// Names are a length then the characters, padded to a whole word
+static void PutName(vector<char>& buffer, const string& name) {
+	PutWord(buffer, static_cast<uint32_t>(name.size()));
+	buffer.insert(buffer.end(), name.begin(), name.end());
+	while (buffer.size() % sizeof(uint32_t) != 0)
+		buffer.push_back(0);
+}
+
+static uint32_t NameIndex(Dict<atom_t, uint32_t>& indices, vector<string>& names, const string& name) {
+	atom_t atom = Intern(name);
+	const uint32_t* index = indices.Get(atom);
+	if (index != nullptr)
+		return *index;
+	uint32_t added = static_cast<uint32_t>(names.size());
+	indices.Put(atom, added);
+	names.push_back(name);
+	return added;
+}
+
+static_assert(sizeof(opcode_t) == sizeof(uint32_t), "opcodes are read as words");
+
+// The opcode as it lies in the file, which need not be one of opcode_t
+static uint32_t Opcode(const instruction_t& ins) {
+	uint32_t op = 0;
+	memcpy(&op, &ins.op, sizeof(op));
+	return op;
+}
+
+static unsigned long ProcessId() {
+#ifdef _WIN32
+	return GetCurrentProcessId();
+#else
+	return static_cast<unsigned long>(getpid());
+#endif
+}
+
+// Moves from over to, replacing it in one step
+static bool Replace(const string& from, const string& to) {
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// Reads words of a mapped file, failing instead of reading past its end
+class CacheReader {
+private:
+	const char*		data;
+	size_t			length;
+	size_t			offset;
+public:
+	CacheReader(const char* data, size_t length) {
+		this->data = data;
+		this->length = length;
+		offset = 0;
+	}
+
+	size_t Offset() const {
+		return offset;
+	}
+
+	bool Word(uint32_t* word) {
+		if (length - offset < sizeof(uint32_t))
+			return false;
+		memcpy(word, data + offset, sizeof(uint32_t));
+		offset += sizeof(uint32_t);
+		return true;
+	}
+
+	bool Name(string* name) {
+		uint32_t size = 0;
+		if (!Word(&size) || length - offset < size)
+			return false;
+		name->assign(data + offset, size);
+		offset += size;
+		offset += (sizeof(uint32_t) - offset % sizeof(uint32_t)) % sizeof(uint32_t);
+		return offset <= length;
+	}
+};
+
+BytecodeCache::BytecodeCache() {
+}
+
+BytecodeCache::~BytecodeCache() {
+}
+
+const string& BytecodeCache::Error() const {
+	return error;
+}
+
+bool BytecodeCache::_Fail(const string& details) {
+	error = details;
+	return false;
+}
+
+uint64_t BytecodeCache::Hash(const Source* source) {
+	assert(source != nullptr);
+	uint64_t hash = 14695981039346656037ull;
+	const unsigned char* p = (const unsigned char*)source->Data();
+	for (size_t i = 0; i < source->Length(); ++i) {
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool BytecodeCache::Save(const string& fileName, const BytecodeProgram* program, const Source* source) {
+	assert(program != nullptr);
+	assert(source != nullptr);
+	error.clear();
+
+	Dict<atom_t, uint32_t> indices;
+	vector<string> names;
+	vector<uint32_t> functionNames;
+	vector<uint32_t> siteNames;
+	for (size_t i = 0; i < program->NumFunctions(); ++i)
+		functionNames.push_back(NameIndex(indices, names, program->Function(i).name));
+	for (size_t i = 0; i < program->NumCallSites(); ++i)
+		siteNames.push_back(NameIndex(indices, names, AtomName(program->CallSite(i).name)));
+
+	uint64_t hash = Hash(source);
+	vector<char> buffer;
+	buffer.insert(buffer.end(), CACHE_MAGIC, CACHE_MAGIC + sizeof(CACHE_MAGIC));
+	PutWord(buffer, BYTECODE_CACHE_VERSION);
+	PutWord(buffer, CACHE_BYTE_ORDER);
+	PutWord(buffer, sizeof(instruction_t));
+	PutWord(buffer, static_cast<uint32_t>(hash));
+	PutWord(buffer, static_cast<uint32_t>(hash >> 32));
+	PutWord(buffer, static_cast<uint32_t>(source->Length()));
+	PutWord(buffer, static_cast<uint32_t>(names.size()));
+	PutWord(buffer, static_cast<uint32_t>(program->NumFunctions()));
+	PutWord(buffer, static_cast<uint32_t>(program->NumCallSites()));
+
+	for (size_t i = 0; i < names.size(); ++i)
+		PutName(buffer, names[i]);
+
+	// Instructions follow the records, function after function
+	size_t code = buffer.size() + sizeof(uint32_t) *
+		(program->NumFunctions() * CACHE_FUNCTION_WORDS +
+		program->NumCallSites() * CACHE_CALL_SITE_WORDS);
+	for (size_t i = 0; i < program->NumFunctions(); ++i) {
+		const bytecodeFunction_t& f = program->Function(i);
+		PutWord(buffer, functionNames[i]);
+		PutWord(buffer, static_cast<uint32_t>(f.numParameters));
+		PutWord(buffer, static_cast<uint32_t>(f.numSlots));
+		PutWord(buffer, static_cast<uint32_t>(f.numRegisters));
+		PutWord(buffer, static_cast<uint32_t>(f.numInstructions));
+		PutWord(buffer, static_cast<uint32_t>(code));
+		code += f.numInstructions * sizeof(instruction_t);
+	}
+	for (size_t i = 0; i < program->NumCallSites(); ++i) {
+		const callSite_t& site = program->CallSite(i);
+		PutWord(buffer, siteNames[i]);
+		PutWord(buffer, static_cast<uint32_t>(site.function));
+		PutWord(buffer, static_cast<uint32_t>(site.numArguments));
+	}
+	for (size_t i = 0; i < program->NumFunctions(); ++i) {
+		const bytecodeFunction_t& f = program->Function(i);
+		const char* p = (const char*)f.instructions;
+		buffer.insert(buffer.end(), p, p + f.numInstructions * sizeof(instruction_t));
+	}
+	assert(buffer.size() == code);
+
+	// Other processes may be running from a mapping of the old file, so
+	// it is replaced whole rather than truncated and written over
+	string temp = fileName + "." + to_string(ProcessId()) + ".tmp";
+	FILE* p = OpenFile(temp, "wb");
+	if (p == nullptr)
+		return _Fail("cannot write " + temp);
+	size_t written = fwrite(buffer.data(), 1, buffer.size(), p);
+	bool closed = fclose(p) == 0;
+	if (written != buffer.size() || !closed) {
+		remove(temp.c_str());
+		return _Fail("cannot write " + temp);
+	}
+	if (!Replace(temp, fileName)) {
+		remove(temp.c_str());
+		return _Fail("cannot replace " + fileName);
+	}
+	return true;
+}
+
+BytecodeProgramRef BytecodeCache::Load(const string& fileName, const Source* source) {
+	assert(source != nullptr);
+	error.clear();
+
+	MappedFileRef file = new MappedFile();
+	if (!file->Open(fileName)) {
+		_Fail("cannot open " + fileName);
+		return nullptr;
+	}
+
+	CacheReader reader(file->Data(), file->Length());
+	uint32_t header[CH_SIZE];
+	for (size_t i = 0; i < CH_SIZE; ++i) {
+		if (!reader.Word(&header[i])) {
+			_Fail(fileName + " is truncated");
+			return nullptr;
+		}
+	}
+
+	uint64_t hash = ((uint64_t)header[CH_HASH_HIGH] << 32) | header[CH_HASH_LOW];
+	if (memcmp(&header[CH_MAGIC], CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+		_Fail(fileName + " is not a bytecode cache");
+		return nullptr;
+	}
+	if (header[CH_VERSION] != BYTECODE_CACHE_VERSION) {
+		_Fail(fileName + " is version " + to_string(header[CH_VERSION]) +
+			", expected " + to_string(BYTECODE_CACHE_VERSION));
+		return nullptr;
+	}
+	if (header[CH_BYTE_ORDER] != CACHE_BYTE_ORDER || header[CH_INSTRUCTION_SIZE] != sizeof(instruction_t)) {
+		_Fail(fileName + " was written by another build");
+		return nullptr;
+	}
+	if (hash != Hash(source) || header[CH_SOURCE_LENGTH] != source->Length()) {
+		_Fail(fileName + " is stale");
+		return nullptr;
+	}
+
+	// Counts are checked against the file before anything is sized by them
+	size_t records = (size_t)header[CH_NUM_NAMES] +
+		(size_t)header[CH_NUM_FUNCTIONS] * CACHE_FUNCTION_WORDS +
+		(size_t)header[CH_NUM_CALL_SITES] * CACHE_CALL_SITE_WORDS;
+	if (records > (file->Length() - reader.Offset()) / sizeof(uint32_t)) {
+		_Fail(fileName + " is truncated");
+		return nullptr;
+	}
+
+	vector<string> names(header[CH_NUM_NAMES]);
+	for (size_t i = 0; i < names.size(); ++i) {
+		if (!reader.Name(&names[i])) {
+			_Fail(fileName + " is truncated");
+			return nullptr;
+		}
+	}
+
+	BytecodeProgramRef program = new BytecodeProgram();
+	program->storage = file;
+	program->functions.resize(header[CH_NUM_FUNCTIONS]);
+	program->callSites.resize(header[CH_NUM_CALL_SITES]);
+
+	for (size_t i = 0; i < program->functions.size(); ++i) {
+		uint32_t record[CACHE_FUNCTION_WORDS];
+		for (size_t j = 0; j < CACHE_FUNCTION_WORDS; ++j) {
+			if (!reader.Word(&record[j])) {
+				_Fail(fileName + " is truncated");
+				return nullptr;
+			}
+		}
+
+		// Instructions are used in place, so they must lie aligned and
+		// whole within the file
+		size_t offset = record[5];
+		size_t count = record[4];
+		if (record[0] >= names.size() || offset % alignof(instruction_t) != 0 ||
+			offset > file->Length() || count > (file->Length() - offset) / sizeof(instruction_t)) {
+			_Fail(fileName + " has a damaged function " + to_string(i));
+			return nullptr;
+		}
+
+		bytecodeFunction_t& f = program->functions[i];
+		f.name = names[record[0]];
+		f.numParameters = record[1];
+		f.numSlots = record[2];
+		f.numRegisters = record[3];
+		f.numInstructions = count;
+		f.instructions = (const instruction_t*)(file->Data() + offset);
+	}
+
+	for (size_t i = 0; i < program->callSites.size(); ++i) {
+		uint32_t record[CACHE_CALL_SITE_WORDS];
+		for (size_t j = 0; j < CACHE_CALL_SITE_WORDS; ++j) {
+			if (!reader.Word(&record[j])) {
+				_Fail(fileName + " is truncated");
+				return nullptr;
+			}
+		}
+		if (record[0] >= names.size()) {
+			_Fail(fileName + " has a damaged call site " + to_string(i));
+			return nullptr;
+		}
+
+		callSite_t& site = program->callSites[i];
+		site.name = Intern(names[record[0]]);
+		site.function = static_cast<int>(record[1]);
+		site.numArguments = record[2];
+	}
+
+	if (!_Validate(program.get())) {
+		error = fileName + " " + error;
+		return nullptr;
+	}
+	return program;
+}
+
+// Everything the VM takes on trust from the compiler: registers, slots,
+// jumps and calls within bounds, and no way to run off the end of a
+// function
+bool BytecodeCache::_Validate(const BytecodeProgram* program) {
+	if (program->NumFunctions() == 0)
+		return _Fail("has no functions");
+	if (program->Function(0).numParameters != 0)
+		return _Fail("has a top level with parameters");
+
+	const size_t numGlobals = program->Function(0).numSlots;
+	for (size_t i = 0; i < program->NumFunctions(); ++i) {
+		const bytecodeFunction_t& f = program->Function(i);
+		string where = "in function " + to_string(i);
+		if (f.numParameters > f.numSlots || f.numSlots > f.numRegisters)
+			return _Fail("has more slots than registers " + where);
+		if (f.numRegisters > CACHE_MAX_REGISTERS)
+			return _Fail("has too many registers " + where);
+		if (f.numInstructions == 0 || Opcode(f.instructions[f.numInstructions - 1]) != OP_RET)
+			return _Fail("does not end with a return " + where);
+
+		auto Register = [&](int r) {
+			return r >= 0 && static_cast<size_t>(r) < f.numRegisters;
+		};
+		auto Slot = [&](int s) {
+			return s >= 0 && static_cast<size_t>(s) < f.numSlots;
+		};
+		auto Global = [&](int g) {
+			return g == -1 || (g >= 0 && static_cast<size_t>(g) < numGlobals);
+		};
+		auto Target = [&](int t) {
+			return t >= 0 && static_cast<size_t>(t) < f.numInstructions;
+		};
+
+		for (size_t pc = 0; pc < f.numInstructions; ++pc) {
+			const instruction_t& ins = f.instructions[pc];
+			bool ok = true;
+			switch (Opcode(ins)) {
+				case OP_NOP:
+					break;
+				case OP_NULL:
+				case OP_INT:
+				case OP_INC:
+				case OP_DEC:
+				case OP_ENTER:
+				case OP_LEAVE:
+				case OP_RET:
+				case OP_BREAK:
+					ok = Register(ins.a);
+					break;
+				case OP_MOVE:
+				case OP_NOT:
+					ok = Register(ins.a) && Register(ins.b);
+					break;
+				case OP_GETVAR:
+				case OP_INCVAR:
+				case OP_DECVAR:
+					ok = Register(ins.a) && Slot(ins.b) && Global(ins.c);
+					break;
+				case OP_SETVAR:
+					ok = Slot(ins.a) && Register(ins.b) && Global(ins.c);
+					break;
+				case OP_ADD:
+				case OP_SUB:
+					ok = Register(ins.a) && Register(ins.b) && Register(ins.c);
+					break;
+				case OP_JMP:
+					ok = Target(ins.b);
+					break;
+				case OP_JMPZ:
+					ok = Register(ins.a) && Target(ins.b);
+					break;
+				case OP_JMPBRK:
+					ok = Register(ins.a) && (ins.b == -1 || Target(ins.b)) &&
+						(ins.c == -1 || Register(ins.c));
+					break;
+				case OP_CALL:
+				case OP_TAILCALL:
+				case OP_CALLNATIVE: {
+					if (!Register(ins.a) || ins.b < 0 || static_cast<size_t>(ins.b) >= program->NumCallSites() ||
+						ins.c < 0 || static_cast<size_t>(ins.c) > f.numRegisters) {
+						ok = false;
+						break;
+					}
+					// Arguments are read from the top of the frame
+					const callSite_t& site = program->CallSite(ins.b);
+					ok = site.numArguments <= f.numRegisters - ins.c;
+					if (ins.op == OP_CALLNATIVE) {
+						ok = ok && site.function == -1;
+					} else {
+						ok = ok && site.function > 0 &&
+							static_cast<size_t>(site.function) < program->NumFunctions() &&
+							program->Function(site.function).numParameters == site.numArguments;
+					}
+					break;
+				}
+				default:
+					ok = false;
+					break;
+			}
+			if (!ok)
+				return _Fail("has a bad instruction at " + to_string(pc) + " " + where);
+		}
+	}
+	return true;
+}
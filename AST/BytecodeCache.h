@@ -0,0 +1,40 @@
+#ifndef __BYTECODE_CACHE_H__
+#define __BYTECODE_CACHE_H__
+
+#include "Common.h"
+#include "Bytecode.h"
+#include "Source.h"
+
+// Bumped whenever the file layout or the meaning of an instruction
+// changes, files of any other version are not loaded
+const uint32_t BYTECODE_CACHE_VERSION = 2;
+
+// Compiled programs saved next to their source, so a start with an
+// unchanged script skips the lexer, the parser and the compiler. A file
+// is the header, the names used, the functions and call sites, then the
+// instructions of every function, all in 32 bit words. Instructions are
+// run from the mapped file where they lie, once each one is checked to
+// stay within its function, its registers and the program.
+class BytecodeCache {
+private:
+	string				error;
+private:
+	bool				_Fail(const string& details);
+	bool				_Validate(const BytecodeProgram* program);
+public:
+						BytecodeCache();
+						~BytecodeCache();
+
+	// FNV-1a of the source text, which a file must match to be loaded
+	static uint64_t		Hash(const Source* source);
+
+	bool				Save(const string& fileName, const BytecodeProgram* program, const Source* source);
+
+	// Null when the file is missing, damaged, of another version or build,
+	// or compiled from another source. Error() tells which.
+	BytecodeProgramRef	Load(const string& fileName, const Source* source);
+
+	const string&		Error() const;
+};
+
+#endif // __BYTECODE_CACHE_H__
@@ -0,0 +1,404 @@
+#include "Compiler.h"
+
+Compiler::Compiler() {
+	function = nullptr;
+	resultRegister = 0;
+	nextRegister = 0;
+	called = false;
+}
+
+Compiler::~Compiler() {
+}
+
+int Compiler::_AllocRegister() {
+	int reg = nextRegister++;
+	if (static_cast<size_t>(nextRegister) > function->numRegisters)
+		function->numRegisters = nextRegister;
+	return reg;
+}
+
+void Compiler::_FreeRegister(int reg) {
+	assert(reg == nextRegister - 1);
+	(void)reg;
+	nextRegister--;
+}
+
+size_t Compiler::_Emit(opcode_t op, int a, int b, int c) {
+	instruction_t ins;
+	ins.op = op;
+	ins.a = a;
+	ins.b = b;
+	ins.c = c;
+	function->code.push_back(ins);
+	return function->code.size() - 1;
+}
+
+size_t Compiler::_Here() const {
+	return function->code.size();
+}
+
+void Compiler::_Patch(size_t at, size_t target) {
+	assert(function->code[at].op == OP_JMP || function->code[at].op == OP_JMPZ ||
+		function->code[at].op == OP_JMPBRK);
+	function->code[at].b = static_cast<int>(target);
+}
+
+void Compiler::_BeginFunction(size_t index, const string& name, size_t numParams, int numSlots) {
+	function = &program->functions[index];
+	function->name = name;
+	function->numParameters = numParams;
+	function->numSlots = numSlots;
+	function->numRegisters = numSlots;
+	function->code.clear();
+
+	// Variables first, then the result of the last statement, then temporaries
+	nextRegister = numSlots;
+	resultRegister = _AllocRegister();
+
+	scopeMarks.clear();
+	loops.clear();
+	called = false;
+}
+
+void Compiler::_EndFunction() {
+	_Emit(OP_RET, resultRegister);
+	assert(nextRegister == resultRegister + 1);
+	assert(scopeMarks.size() == 0);
+	assert(loops.size() == 0);
+	function->instructions = function->code.data();
+	function->numInstructions = function->code.size();
+	function = nullptr;
+}
+
+// A break in a called function stops its caller the way the interpreter
+// does, checked where the statement that made the call ends. Inside a
+// loop it breaks the loop, otherwise it unwinds further.
+void Compiler::_CheckBreak() {
+	called = false;
+	if (loops.size() == 0) {
+		_Emit(OP_JMPBRK, resultRegister, -1, -1);
+		return;
+	}
+
+	loop_t& loop = loops.back();
+	int mark = (scopeMarks.size() > loop.scopeDepth) ? scopeMarks[loop.scopeDepth] : -1;
+	loop.breaks.push_back(_Emit(OP_JMPBRK, resultRegister, 0, mark));
+}
+
+void Compiler::_CompileFunction(ASTFuncDef* node, size_t index) {
+	assert(node->NumSlots() >= 0);
+
+	// The resolver put parameters in the first slots so arguments
+	// can be passed in place
+	for (size_t i = 0; i < node->NumParameters(); ++i) {
+		assert(node->Parameter(i)->Slot() == static_cast<int>(i));
+	}
+
+	ASTBlock* block = node->Block();
+	_BeginFunction(index, node->Name(), node->NumParameters(), node->NumSlots());
+	// The body shares the frame of the call, no scope needed
+	if (block->NumChildren() == 0)
+		_Emit(OP_NULL, resultRegister);
+	for (size_t i = 0; i < block->NumChildren(); ++i)
+		_CompileStatement(block->Child(i));
+	_EndFunction();
+}
+
+void Compiler::_CompileStatement(ASTNode* node) {
+	assert(node != nullptr);
+	bool outer = called;
+	called = false;
+	switch (node->Type()) {
+		case AST_BLOCK:
+			_CompileStatement((ASTBlock*)node); break;
+		case AST_IF:
+			_CompileStatement((ASTIf*)node); break;
+		case AST_WHILE:
+		case AST_WHILE_VAR_NON_ZERO:
+			_CompileLoop(node); break;
+		case AST_BREAK:
+			_CompileStatement((ASTBreak*)node); break;
+		case AST_RETURN:
+			_CompileStatement((ASTReturn*)node); break;
+		case AST_FUNC_DEF:
+			_Emit(OP_NULL, resultRegister); break;
+		default:
+			_CompileExpression(node, resultRegister); break;
+	}
+	if (called)
+		_CheckBreak();
+	called = outer;
+}
+
+void Compiler::_CompileStatement(ASTBlock* node) {
+	if (node->NumChildren() == 0) {
+		_Emit(OP_NULL, resultRegister);
+		return;
+	}
+
+	int mark = _AllocRegister();
+	_Emit(OP_ENTER, mark);
+	scopeMarks.push_back(mark);
+	for (size_t i = 0; i < node->NumChildren(); ++i)
+		_CompileStatement(node->Child(i));
+	scopeMarks.pop_back();
+	_Emit(OP_LEAVE, mark);
+	_FreeRegister(mark);
+}
+
+void Compiler::_CompileStatement(ASTIf* node) {
+	int cond = _AllocRegister();
+	_CompileExpression(node->Expression(), cond);
+	if (called)
+		_CheckBreak();
+	size_t skip = _Emit(OP_JMPZ, cond);
+	_FreeRegister(cond);
+
+	_CompileStatement(node->Statement());
+	size_t end = _Emit(OP_JMP);
+
+	// A false condition still yields a result
+	_Patch(skip, _Here());
+	_Emit(OP_NULL, resultRegister);
+	_Patch(end, _Here());
+}
+
+// Fused loops test and step their variable with the ops the unfused
+// condition compiles to
+void Compiler::_CompileLoop(ASTNode* node) {
+	_Emit(OP_NULL, resultRegister);
+
+	loop_t loop;
+	loop.scopeDepth = scopeMarks.size();
+	loops.push_back(loop);
+
+	size_t top = _Here();
+	int cond = _AllocRegister();
+	ASTNode* statement = nullptr;
+	if (node->Type() == AST_WHILE_VAR_NON_ZERO) {
+		ASTWhileVarNonZero* loop = (ASTWhileVarNonZero*)node;
+		ASTIdentifier* ident = loop->Identifier();
+		if (loop->Step() == 0)
+			_CompileExpression(ident, cond);
+		else
+			_CompileStep(ident, cond, loop->Step() > 0);
+		statement = loop->Statement();
+	} else {
+		ASTWhile* loop = (ASTWhile*)node;
+		_CompileExpression(loop->Expression(), cond);
+		statement = loop->Statement();
+	}
+	if (called)
+		_CheckBreak();
+	size_t exit = _Emit(OP_JMPZ, cond);
+	_FreeRegister(cond);
+
+	_CompileStatement(statement);
+	_Emit(OP_JMP, 0, static_cast<int>(top));
+
+	size_t end = _Here();
+	_Patch(exit, end);
+	for (size_t i = 0; i < loops.back().breaks.size(); ++i)
+		_Patch(loops.back().breaks[i], end);
+	loops.pop_back();
+}
+
+void Compiler::_CompileStatement(ASTBreak*) {
+	_Emit(OP_NULL, resultRegister);
+
+	// Outside of a loop a break stops the current function and goes on
+	// to break its caller
+	if (loops.size() == 0) {
+		_Emit(OP_BREAK, resultRegister);
+		return;
+	}
+
+	loop_t& loop = loops.back();
+	if (scopeMarks.size() > loop.scopeDepth)
+		_Emit(OP_LEAVE, scopeMarks[loop.scopeDepth]);
+	loop.breaks.push_back(_Emit(OP_JMP));
+}
+
+void Compiler::_CompileStatement(ASTReturn* node) {
+	ASTNode* expression = node->Expression();
+	// The top level has no frame to hand over
+	if (expression->Type() == AST_CALL && function != &program->functions[0]) {
+		_CompileExpression((ASTCall*)expression, resultRegister, true);
+		called = false;
+		return;
+	}
+
+	// The return ends a loop the call broke before the break can reach
+	// the caller, out of any loop the break is passed on
+	_CompileExpression(expression, resultRegister);
+	if (called && loops.size() > 0)
+		_Emit(OP_JMPBRK, resultRegister, static_cast<int>(_Here() + 1), -1);
+	called = false;
+	_Emit(OP_RET, resultRegister);
+}
+
+void Compiler::_CompileExpression(ASTNode* node, int dst) {
+	assert(node != nullptr);
+	switch (node->Type()) {
+		case AST_INT_LITERAL:
+			_Emit(OP_INT, dst, ((ASTIntLiteral*)node)->Value());
+			break;
+		case AST_IDENTIFIER: {
+			ASTIdentifier* ident = (ASTIdentifier*)node;
+			assert(ident->Slot() >= 0);
+			_Emit(OP_GETVAR, dst, ident->Slot(), ident->GlobalSlot());
+			break;
+		}
+		case AST_ASSIGN: {
+			ASTAssign* assign = (ASTAssign*)node;
+			ASTIdentifier* ident = assign->LHS();
+			assert(ident->Slot() >= 0);
+			_CompileExpression(assign->RHS(), dst);
+			_Emit(OP_SETVAR, ident->Slot(), dst, ident->GlobalSlot());
+			break;
+		}
+		case AST_ADD:
+		case AST_SUBTRACT: {
+			// Chains are deep on the left, accumulate into dst walking
+			// back up instead of recursing down
+			vector<ASTNode*> chain;
+			ASTNode* term = node;
+			while (term->Type() == AST_ADD || term->Type() == AST_SUBTRACT) {
+				chain.push_back(term);
+				term = term->Child(0);
+			}
+
+			_CompileExpression(term, dst);
+			int rhs = _AllocRegister();
+			for (size_t i = chain.size(); i > 0; --i) {
+				ASTNode* op = chain[i - 1];
+				_CompileExpression(op->Child(1), rhs);
+				_Emit(op->Type() == AST_ADD ? OP_ADD : OP_SUB, dst, dst, rhs);
+			}
+			_FreeRegister(rhs);
+			break;
+		}
+		case AST_NOT:
+			_CompileExpression(((ASTNot*)node)->Expression(), dst);
+			_Emit(OP_NOT, dst, dst);
+			break;
+		case AST_INCREMENT:
+			_CompileStep(node->Child(0), dst, true);
+			break;
+		case AST_DECREMENT:
+			_CompileStep(node->Child(0), dst, false);
+			break;
+		case AST_CALL:
+			_CompileExpression((ASTCall*)node, dst);
+			break;
+		case AST_ADD_ASSIGN_CONST: {
+			ASTAddAssignConst* fused = (ASTAddAssignConst*)node;
+			ASTIdentifier* ident = fused->Identifier();
+			assert(ident->Slot() >= 0);
+			_Emit(OP_GETVAR, dst, ident->Slot(), ident->GlobalSlot());
+			int rhs = _AllocRegister();
+			_Emit(OP_INT, rhs, fused->Constant());
+			_Emit(OP_ADD, dst, dst, rhs);
+			_FreeRegister(rhs);
+			_Emit(OP_SETVAR, ident->Slot(), dst, ident->GlobalSlot());
+			break;
+		}
+		case AST_NOT_SUB_CONST: {
+			ASTNotSubConst* fused = (ASTNotSubConst*)node;
+			ASTIdentifier* ident = fused->Identifier();
+			assert(ident->Slot() >= 0);
+			_Emit(OP_GETVAR, dst, ident->Slot(), ident->GlobalSlot());
+			int rhs = _AllocRegister();
+			_Emit(OP_INT, rhs, fused->Constant());
+			_Emit(OP_SUB, dst, dst, rhs);
+			_FreeRegister(rhs);
+			_Emit(OP_NOT, dst, dst);
+			break;
+		}
+		default:
+			assert(false);
+			_Emit(OP_NULL, dst);
+			break;
+	}
+}
+
+void Compiler::_CompileExpression(ASTCall* node, int dst, bool tail) {
+	size_t numArgs = node->NumArguments();
+
+	// Arguments are laid out at the top of the frame, where the
+	// callee frame begins
+	int base = nextRegister;
+	for (size_t i = 0; i < numArgs; ++i)
+		_AllocRegister();
+	for (size_t i = 0; i < numArgs; ++i)
+		_CompileExpression(node->Argument(i), base + static_cast<int>(i));
+
+	callSite_t site;
+	site.name = node->Identifier()->Atom();
+	site.numArguments = numArgs;
+
+	const int* index = functionIndices.Get(site.name);
+	site.function = (index != nullptr) ? *index : -1;
+	program->callSites.push_back(site);
+
+	int siteIndex = static_cast<int>(program->callSites.size() - 1);
+	if (index == nullptr) {
+		_Emit(OP_CALLNATIVE, dst, siteIndex, base);
+		if (tail)
+			_Emit(OP_RET, dst);
+	} else {
+		_Emit(tail ? OP_TAILCALL : OP_CALL, dst, siteIndex, base);
+		called = true;
+	}
+
+	for (size_t i = 0; i < numArgs; ++i)
+		_FreeRegister(nextRegister - 1);
+}
+
+void Compiler::_CompileStep(ASTNode* node, int dst, bool increment) {
+	if (node->Type() != AST_IDENTIFIER) {
+		_CompileExpression(node, dst);
+		_Emit(increment ? OP_INC : OP_DEC, dst);
+		return;
+	}
+
+	ASTIdentifier* ident = (ASTIdentifier*)node;
+	assert(ident->Slot() >= 0);
+	_Emit(increment ? OP_INCVAR : OP_DECVAR, dst, ident->Slot(), ident->GlobalSlot());
+}
+
+BytecodeProgramRef Compiler::Compile(ASTProgram* node) {
+	assert(node != nullptr);
+	assert(node->NumSlots() >= 0);
+	program = new BytecodeProgram();
+	functionIndices.Clear();
+
+	// Function 0 holds the top level, definitions follow in order.
+	// Later definitions of a name win as they do in the interpreter.
+	program->functions.resize(1);
+	for (size_t i = 0; i < node->NumChildren(); ++i) {
+		ASTNode* child = node->Child(i);
+		if (child->Type() == AST_FUNC_DEF) {
+			int index = static_cast<int>(program->functions.size());
+			program->functions.push_back(bytecodeFunction_t());
+			functionIndices.Put(((ASTFuncDef*)child)->Atom(), index);
+		}
+	}
+
+	_BeginFunction(0, "", 0, node->NumSlots());
+	_Emit(OP_NULL, resultRegister);
+	for (size_t i = 0; i < node->NumChildren(); ++i)
+		_CompileStatement(node->Child(i));
+	_EndFunction();
+
+	size_t index = 1;
+	for (size_t i = 0; i < node->NumChildren(); ++i) {
+		ASTNode* child = node->Child(i);
+		if (child->Type() == AST_FUNC_DEF)
+			_CompileFunction((ASTFuncDef*)child, index++);
+	}
+
+	BytecodeProgramRef result = program;
+	program = nullptr;
+	return result;
+}
@@ -0,0 +1,52 @@
+#ifndef __COMPILER_H__
+#define __COMPILER_H__
+
+#include "Common.h"
+#include "AST.h"
+#include "Dict.h"
+#include "Bytecode.h"
+
+class Compiler {
+private:
+	struct loop_t {
+		vector<size_t>		breaks;
+		size_t				scopeDepth;
+	};
+	BytecodeProgramRef		program;
+	bytecodeFunction_t*		function;
+	Dict<atom_t, int>		functionIndices;
+	int						resultRegister;
+	int						nextRegister;
+	vector<int>				scopeMarks;
+	vector<loop_t>			loops;
+	// A script function was called since the last break check
+	bool					called;
+private:
+	int			_AllocRegister();
+	void		_FreeRegister(int reg);
+	size_t		_Emit(opcode_t op, int a = 0, int b = 0, int c = 0);
+	size_t		_Here() const;
+	void		_Patch(size_t at, size_t target);
+	void		_BeginFunction(size_t index, const string& name, size_t numParams, int numSlots);
+	void		_EndFunction();
+	void		_CheckBreak();
+private:
+	void		_CompileFunction(ASTFuncDef* node, size_t index);
+	void		_CompileStatement(ASTNode* node);
+	void		_CompileStatement(ASTBlock* node);
+	void		_CompileStatement(ASTIf* node);
+	void		_CompileLoop(ASTNode* node);
+	void		_CompileStatement(ASTBreak*);
+	void		_CompileStatement(ASTReturn* node);
+	void		_CompileExpression(ASTNode* node, int dst);
+	void		_CompileExpression(ASTCall* node, int dst, bool tail = false);
+	void		_CompileStep(ASTNode* node, int dst, bool increment);
+public:
+				Compiler();
+				~Compiler();
+
+	// Lower a parsed and resolved program to bytecode
+	BytecodeProgramRef Compile(ASTProgram* node);
+};
+
+#endif // __COMPILER_H__
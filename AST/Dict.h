@@ -2,108 +2,178 @@
 #define __DICT_H__
 
 #include "Common.h"
+#include <cstdint>
 
+// 32 bit FNV-1a
+inline uint32_t DictHash(const char* str, size_t length) {
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < length; ++i) {
+		h ^= static_cast<uint8_t>(str[i]);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+inline uint32_t DictHash(const string& str) {
+	return DictHash(str.data(), str.size());
+}
+
+// Finaliser from murmur3, spreads small integers over the table
+inline uint32_t DictHash(uint32_t v) {
+	v ^= v >> 16;
+	v *= 0x85ebca6bu;
+	v ^= v >> 13;
+	v *= 0xc2b2ae35u;
+	v ^= v >> 16;
+	return v;
+}
+
+inline uint32_t DictHash(int v) {
+	return DictHash(static_cast<uint32_t>(v));
+}
+
+// Open addressing with linear probing over a power of two table.
+// Hashes are cached next to the keys so probing and growing never
+// rehash a key. A cached hash of zero marks an empty entry.
 template<class K, class T> class Dict {
 protected:
 	typedef int(*hashFunc_t)(const K& v);
-	typedef vector<T> valueBin_t;
-	typedef vector<K> keyBin_t;
-	hashFunc_t	hashFunc;
-	valueBin_t* values;
-	keyBin_t*	keys;
-	int			bins;
+	struct entry_t {
+		uint32_t	hash;
+		K			key;
+		T			value;
+	};
+	hashFunc_t		hashFunc;
+	vector<entry_t>	entries;
+	size_t			count;
+	size_t			initialCapacity;
 protected:
-	int _Bin(int hash) const {
-		assert(hash >= 0);
-		return hash % bins;
+	static const size_t MIN_CAPACITY = 8;
+
+	static int _Hash(const K& key) {
+		return static_cast<int>(DictHash(key));
+	}
+
+	uint32_t _HashOf(const K& key) const {
+		uint32_t h = static_cast<uint32_t>(hashFunc(key));
+		return (h != 0) ? h : 1;
 	}
-	const T* _Search(int bin, const K& key) const {
-		size_t binSize = keys[bin].size();
-		keyBin_t& keyBin = keys[bin];
-		valueBin_t& valueBin = values[bin];
-		for (size_t i = 0; i < binSize; ++i) {
-			if (keyBin[i] == key)
-				return &valueBin[i];
+
+	size_t _Find(uint32_t hash, const K& key) const {
+		size_t mask = entries.size() - 1;
+		size_t i = hash & mask;
+		while (entries[i].hash != 0) {
+			if (entries[i].hash == hash && entries[i].key == key)
+				return i;
+			i = (i + 1) & mask;
 		}
-		return nullptr;
+		return i;
 	}
-protected:
-	static int _Hash(const string& str) {
-		int mul = 1;
-		for (size_t i = 0; i < str.size(); ++i)
-			mul *= (1+str[i]);
-		return mul & 0xFFFF;
+
+	void _Grow() {
+		size_t capacity = entries.size() > 0 ? entries.size() * 2 : initialCapacity;
+		vector<entry_t> old(capacity);
+		old.swap(entries);
+
+		size_t mask = capacity - 1;
+		for (size_t j = 0; j < old.size(); ++j) {
+			if (old[j].hash == 0)
+				continue;
+			size_t i = old[j].hash & mask;
+			while (entries[i].hash != 0)
+				i = (i + 1) & mask;
+			entries[i].hash = old[j].hash;
+			entries[i].key = std::move(old[j].key);
+			entries[i].value = std::move(old[j].value);
+		}
 	}
 public:
 	class ForwardIterator {
 	private:
-		Dict*	dict;
-		int		bin;
-		size_t	index;
+		const Dict*	dict;
+		size_t		index;
+		void _Skip() {
+			while (index < dict->entries.size() && dict->entries[index].hash == 0)
+				index++;
+		}
 	public:
-		ForwardIterator(Dict* d) : dict(d), index(0), bin(0) {
+		ForwardIterator(const Dict* d) : dict(d), index(0) {
+			_Skip();
+		}
+		bool Valid() const {
+			return index < dict->entries.size();
+		}
+		const K& Key() const {
+			return dict->entries[index].key;
+		}
+		const T& Value() const {
+			return dict->entries[index].value;
 		}
-		const K& Key() const;
-		const T& Value() const;
 		void Next() {
 			index++;
-			if(index > dict->values[bin].size())
+			_Skip();
 		}
 	};
 public:
 
+	// The table is allocated on the first Put
 	Dict(hashFunc_t hash, int binCount) {
-		bins = binCount;
-		values = new valueBin_t[bins];
-		keys = new keyBin_t[bins];
 		hashFunc = hash;
+		count = 0;
+		initialCapacity = MIN_CAPACITY;
+		while (initialCapacity < static_cast<size_t>(binCount))
+			initialCapacity *= 2;
 	}
 
-	Dict() : Dict(Dict::_Hash, 32) {
+	Dict() : Dict(Dict::_Hash, MIN_CAPACITY) {
 	}
 
 	~Dict() {
-		delete[] values;
-		delete[] keys;
 	}
 
 	void Clear() {
-		for (int i = 0; i < bins; ++i) {
-			values[i].clear();
-			keys[i].clear();
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (entries[i].hash != 0)
+				entries[i] = entry_t();
 		}
+		count = 0;
 	}
 
 	void Put(const K& key, const T& value) {
-		int hash = hashFunc(key);
-		int bin = _Bin(hash);
-
-		T* v = const_cast<T*>(_Search(bin, key));
-		if (v == nullptr) {
-			keys[bin].push_back(key);
-			values[bin].push_back(value);
-		} else {
-			(*v) = value;
+		// Keep the load factor at or below 3/4
+		if ((count + 1) * 4 > entries.size() * 3)
+			_Grow();
+
+		uint32_t hash = _HashOf(key);
+		size_t i = _Find(hash, key);
+		if (entries[i].hash == 0) {
+			entries[i].hash = hash;
+			entries[i].key = key;
+			count++;
 		}
+		entries[i].value = value;
 	}
 
 	T* Get(const K& key) {
-		int hash = hashFunc(key);
-		int bin = _Bin(hash);
-		return const_cast<T*>(_Search(bin, key));
+		if (count == 0)
+			return nullptr;
+		size_t i = _Find(_HashOf(key), key);
+		return (entries[i].hash != 0) ? &entries[i].value : nullptr;
 	}
 
 	const T* Get(const K& key) const {
-		int hash = hashFunc(key);
-		int bin = _Bin(hash);
-		return _Search(bin, key);
+		if (count == 0)
+			return nullptr;
+		size_t i = _Find(_HashOf(key), key);
+		return (entries[i].hash != 0) ? &entries[i].value : nullptr;
 	}
 
 	size_t Size() const {
-		size_t r = 0;
-		for (size_t i = 0; i < bins; ++i)
-			r += bins[i].size();
-		return r;
+		return count;
+	}
+
+	ForwardIterator Begin() const {
+		return ForwardIterator(this);
 	}
 };
 
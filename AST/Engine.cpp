@@ -3,9 +3,18 @@
 Engine::Engine() {
 	callbacks = new CallbackRegistry();
 
-	globalVariableSpace = nullptr;
-	currentVariableSpace = nullptr;
+	current = nullptr;
+
+	tailCall = nullptr;
+	tailFunction = -1;
+	tailArguments = 0;
+	flat = nullptr;
+	callDepth = 0;
+	maxCallDepth = DEFAULT_MAX_CALL_DEPTH;
+	error.code = RT_ERR_NONE;
+	epoch = 1;
 	flags = F_NONE;
+	mode = EXEC_BYTECODE;
 }
 
 Engine::~Engine() {
@@ -15,104 +24,270 @@ void Engine::DefineCallback(const string& name, size_t numParams, callbackFuncti
 	callback_t cb;
 	cb.name = name;
 	cb.callback = func;
+	cb.spanCallback = nullptr;
+	cb.parameters = numParams;
+	DefineCallback(cb);
+}
+
+void Engine::DefineCallback(const string& name, size_t numParams, callbackSpanFunction_t func) {
+	callback_t cb;
+	cb.name = name;
+	cb.callback = nullptr;
+	cb.spanCallback = func;
 	cb.parameters = numParams;
 	DefineCallback(cb);
 }
 
 void Engine::DefineCallback(const callback_t& callback) {
-	callbacks->Put(callback.name, callback);
+	callbacks->Put(Intern(callback.name), callback);
+}
+
+void Engine::SetExecutionMode(executionMode_t m) {
+	mode = m;
+}
+
+executionMode_t Engine::ExecutionMode() const {
+	return mode;
+}
+
+void Engine::SetMaxCallDepth(size_t depth) {
+	maxCallDepth = depth;
+}
+
+size_t Engine::MaxCallDepth() const {
+	return maxCallDepth;
+}
+
+bool Engine::HasError() const {
+	return error.code != RT_ERR_NONE;
+}
+
+runtimeError_t Engine::Error() const {
+	return error;
+}
+
+// The first error wins, F_EXCEPTION unwinds the interpreter
+void Engine::_Error(runtimeErrorCode_t code, const string& details) {
+	if (error.code == RT_ERR_NONE) {
+		error.code = code;
+		error.details = details;
+	}
+	Set(F_EXCEPTION);
+}
+
+// Calls to a name that is not defined, or that takes another number of
+// arguments, stop execution rather than the host
+void Engine::_NoFunction(atom_t name, size_t numArgs) {
+	_Error(RT_ERR_NO_FUNCTION, "no function " + AtomName(name) +
+		" taking " + to_string(numArgs) + " arguments");
+}
+
+void Engine::_Reset() {
+	error.code = RT_ERR_NONE;
+	error.details.clear();
+	flags = F_NONE;
+	callDepth = 0;
+	tailCall = nullptr;
+	tailFunction = -1;
+	argumentStack.clear();
+	additiveStack.clear();
 }
 
 void Engine::_PushScope() {
-	assert(currentVariableSpace != nullptr);
-	currentVariableSpace->PushScope();
+	frames.PushScope();
 }
 
 void Engine::_PopScope() {
-	assert(currentVariableSpace != nullptr);
-	currentVariableSpace->PopScope();
+	frames.PopScope();
 }
 
-void Engine::_PushSpace() {
-	variableSpaces.push_back( new VariableSpace() );
-	currentVariableSpace = variableSpaces.back().get();
-	if (globalVariableSpace == nullptr) {
-		assert(variableSpaces.size() == 1);
-		globalVariableSpace = variableSpaces[0].get();
-	}
+void Engine::_PushFrame(size_t numSlots) {
+	frames.PushFrame(numSlots);
 }
 
-void Engine::_PopSpace() {
-	variableSpaces.pop_back();
-	if (variableSpaces.size() == 0) {
-		assert(globalVariableSpace != nullptr);
-		globalVariableSpace = nullptr;
-	} else {
-		currentVariableSpace = variableSpaces.back().get();
-	}
+void Engine::_PopFrame() {
+	frames.PopFrame();
 }
 
-object_t* Engine::_VariableLookup(const string& name) {
-	assert(currentVariableSpace != nullptr);
+object_t* Engine::_VariableLookup(atom_t name) {
+	assert(frames.NumFrames() > 0);
 	object_t* ptr = nullptr;
-	ptr = currentVariableSpace->Lookup(name);
+	ptr = frames.Lookup(name);
 	if (ptr != nullptr)
 		return ptr;
 
-	ptr = globalVariableSpace->Lookup(name);
+	ptr = frames.LookupGlobal(name);
+	if (ptr != nullptr)
+		return ptr;
+
+	ptr = frames.Define(name);
+	assert(ptr != nullptr);
+	return ptr;
+}
+
+object_t* Engine::_VariableLookup(const ASTIdentifier* ident) {
+	if (ident->Slot() < 0)
+		return _VariableLookup(ident->Atom());
+	return _SlotLookup(ident->Slot(), ident->GlobalSlot());
+}
+
+object_t* Engine::_SlotLookup(int slot, int globalSlot) {
+	assert(slot >= 0);
+	assert(frames.NumFrames() > 0);
+	object_t* ptr = frames.Slot(slot);
 	if (ptr != nullptr)
 		return ptr;
 
-	ptr = currentVariableSpace->Define(name);
+	if (globalSlot >= 0) {
+		ptr = frames.GlobalSlot(globalSlot);
+		if (ptr != nullptr)
+			return ptr;
+	}
+
+	ptr = frames.DefineSlot(slot);
 	assert(ptr != nullptr);
 	return ptr;
 }
 
-object_t* Engine::_VariableAssign(const string& name, const object_t& object) {
+object_t* Engine::_VariableAssign(atom_t name, const object_t& object) {
 	object_t* x = _VariableLookup(name);
 	assert(x != nullptr);
 	*x = object;
 	return x;
 }
 
-object_t Engine::_Invoke(const string& name, const vector<object_t>& args) {
-	ASTFuncDef** funcPtr = functions.Get(name);
-	if (funcPtr == nullptr)
-		return _InvokeCallback(name, args);
+object_t* Engine::_VariableAssign(const ASTIdentifier* ident, const object_t& object) {
+	object_t* x = _VariableLookup(ident);
+	assert(x != nullptr);
+	*x = object;
+	return x;
+}
 
-	ASTFuncDef* func = *funcPtr;
-	_PushSpace();
+// The frame at base was reserved and holds the arguments in the
+// parameter slots
+object_t Engine::_Invoke(ASTFuncDef* func, size_t base) {
+	frames.EnterFrame(base);
 	_PushScope();
-	assert(func->NumParameters() == args.size());
-	for (size_t i = 0; i < args.size(); ++i) {
-		_VariableAssign(func->Parameter(i)->Name(), args[i]);
+	object_t result = Execute(func->Block());
+	_PopScope();
+	// The frame is reused for a tail call, so tail recursion loops here
+	// instead of growing the stack
+	while (tailCall != nullptr) {
+		func = tailCall;
+		tailCall = nullptr;
+		Clear(F_RETURN);
+		frames.ResetFrame(func->NumSlots());
+		_BindTailArguments(func, base);
+		_PushScope();
+		result = Execute(func->Block());
+		_PopScope();
 	}
-	object_t result = Execute(func->Block().get());
+	_PopFrame();
+	return result;
+}
+
+// Functions that were never resolved bind their parameters by name
+object_t Engine::_Invoke(ASTFuncDef* func, const argSpan_t& args) {
+	_PushFrame(0);
+	_PushScope();
+	assert(func->NumParameters() == args.size);
+	for (size_t i = 0; i < args.size; ++i)
+		_VariableAssign(func->Parameter(i)->Atom(), args[i]);
+	object_t result = Execute(func->Block());
 	_PopScope();
-	_PopSpace();
+	_PopFrame();
+	if (tailCall != nullptr) {
+		func = tailCall;
+		tailCall = nullptr;
+		Clear(F_RETURN);
+		size_t base = frames.ReserveFrame(func->NumSlots());
+		_BindTailArguments(func, base);
+		result = _Invoke(func, base);
+	}
 	return result;
 }
 
-object_t Engine::_InvokeCallback(const string& name, const vector<object_t>& args) {
-	callback_t* x = callbacks->Get(name);
-	assert(x != nullptr);
-	assert(x->parameters == args.size());
+// Evaluates the arguments of return f(...) and leaves the call to the
+// _Invoke that owns the current frame. Only resolved script functions
+// can take over a frame.
+bool Engine::_TailCall(ASTCall* node) {
+	if (frames.NumFrames() < 2)
+		return false;
+
+	callCache_t target = _ResolveCall(node);
+	ASTFuncDef* func = target.function;
+	size_t numArgs = node->NumArguments();
+	// A call that fails is left to Execute(ASTCall*) to report
+	if (func == nullptr || func->NumSlots() < 0 || func->NumParameters() != numArgs)
+		return false;
+
+	size_t mark = argumentStack.size();
+	for (size_t i = 0; i < numArgs; ++i) {
+		object_t value = Execute(node->Argument(i));
+		argumentStack.push_back(value);
+	}
+
+	// Still taken as the return, there is nothing left to call
+	if (Test(F_EXCEPTION)) {
+		argumentStack.resize(mark);
+		return true;
+	}
+
+	tailCall = func;
+	tailArguments = mark;
+	return true;
+}
+
+void Engine::_BindTailArguments(ASTFuncDef* func, size_t base) {
+	size_t numArgs = argumentStack.size() - tailArguments;
+	assert(func->NumParameters() == numArgs);
+	for (size_t i = 0; i < numArgs; ++i)
+		*frames.At(base + func->Parameter(i)->Slot()) = argumentStack[tailArguments + i];
+	argumentStack.resize(tailArguments);
+}
+
+object_t Engine::_InvokeCallback(const callback_t* callback, const argSpan_t& args) {
+	assert(callback != nullptr);
+	assert(callback->parameters == args.size);
 
-	object_t ret;
+	object_t ret = NullObject();
 	callbackFailure_t failure;
-	if (!x->callback(args, &ret, &failure)) {
-		assert(false);
+	bool ok = false;
+	if (callback->spanCallback != nullptr) {
+		ok = callback->spanCallback(args, &ret, &failure);
+	} else {
+		vector<object_t> copy(args.data, args.data + args.size);
+		ok = callback->callback(copy, &ret, &failure);
+	}
+	if (!ok) {
+		_Error(RT_ERR_CALLBACK_FAILED, callback->name + ": " + failure.info);
+		return NullObject();
 	}
 	return ret;
 }
 
-void Engine::_PopulateFunctions(ASTProgram* program) {
-	for (size_t i = 0; i < program->NumChildren(); ++i) {
-		if (program->Child(i)->Type() != AST_FUNC_DEF)
-			continue;
-		ASTFuncDef* func = (ASTFuncDef*)program->Child(i).get();
-		functions.Put(func->Name(),func);
-	}
+// Script functions take precedence over callbacks of the same name.
+// The result is cached per call site until another program runs.
+callCache_t Engine::_ResolveCall(ASTCall* node) {
+	int site = node->Site();
+	bool cached = site >= 0 && static_cast<size_t>(site) < callCaches.size();
+	if (cached && callCaches[site].epoch == epoch)
+		return callCaches[site];
+
+	atom_t name = node->Identifier()->Atom();
+	ASTFuncDef* const* func = current->functions.Get(name);
+
+	callCache_t target;
+	target.epoch = epoch;
+	target.function = (func != nullptr) ? *func : nullptr;
+	target.callback = (func != nullptr) ? nullptr : current->callbacks->Get(name);
+	if (cached)
+		callCaches[site] = target;
+	return target;
+}
+
+void Engine::_InvalidateCalls() {
+	epoch++;
 }
 
 bool Engine::Executing() const {
@@ -133,51 +308,124 @@ void Engine::Clear(flag_t flag) {
 	flags = (flag_t)((uint16_t)flags & f);
 }
 
-VariableSpace::VariableSpace() {
-	currentRegistry = nullptr;
+void FrameStack::PushFrame(size_t numSlots) {
+	EnterFrame(ReserveFrame(numSlots));
+}
+
+void FrameStack::PopFrame() {
+	assert(frames.size() > 0);
+	assert(scopes.size() == frames.back().scopes);
+	slots.resize(frames.back().base);
+	frames.pop_back();
 }
 
-object_t* VariableSpace::Lookup(const string& name) {
-	assert(currentRegistry != nullptr);
-	// Check current scope first
-	object_t* objPtr = nullptr;
-	// Go up the tree to the root
-	int i = static_cast<int>(registries.size() - 1);
-	for ( ; i >= 0; i--) {
-		object_t* foundPtr = registries[i]->Get(name);
-		if (foundPtr != nullptr) {
-			objPtr = foundPtr;
-			break;
-		}
+void FrameStack::PushScope() {
+	assert(frames.size() > 0);
+	scope_t scope;
+	scope.defined = defined.size();
+	scopes.push_back(scope);
+}
+
+void FrameStack::PopScope() {
+	assert(scopes.size() > frames.back().scopes);
+	// Slots defined in this scope go out of scope with it
+	while (defined.size() > scopes.back().defined) {
+		slots[defined.back()].type = OT_VOID;
+		defined.pop_back();
 	}
-	return objPtr;
+	scopes.pop_back();
 }
 
-object_t* VariableSpace::Define(const string& name) {
-	object_t empty;
-	empty.type = OT_NULL;
-	currentRegistry->Put(name, empty);
-	return currentRegistry->Get(name);
+size_t FrameStack::NumFrames() const {
+	return frames.size();
 }
 
-object_t* VariableSpace::Assign(const string& name, const object_t & value) {
-	object_t* x = Lookup(name);
-	assert(x != nullptr);
-	*x = value;
+size_t FrameStack::ReserveFrame(size_t numSlots) {
+	size_t base = slots.size();
+	object_t undefined;
+	undefined.type = OT_VOID;
+	undefined.value._int = 0;
+	slots.resize(base + numSlots, undefined);
+	return base;
+}
+
+void FrameStack::ResetFrame(size_t numSlots) {
+	assert(frames.size() > 0);
+	assert(scopes.size() == frames.back().scopes);
+	slots.resize(frames.back().base);
+	ReserveFrame(numSlots);
+}
+
+// Drops a reserved frame that is not going to be entered
+void FrameStack::ReleaseFrame(size_t base) {
+	assert(base <= slots.size());
+	slots.resize(base);
+}
+
+void FrameStack::EnterFrame(size_t base) {
+	assert(base <= slots.size());
+	frame_t frame;
+	frame.base = base;
+	frame.scopes = scopes.size();
+	frames.push_back(frame);
+}
+
+object_t* FrameStack::At(size_t index) {
+	return &slots[index];
+}
+
+object_t* FrameStack::Slot(int slot) {
+	object_t* x = &slots[frames.back().base + slot];
+	return (x->type != OT_VOID) ? x : nullptr;
+}
+
+object_t* FrameStack::GlobalSlot(int slot) {
+	object_t* x = &slots[slot];
+	return (x->type != OT_VOID) ? x : nullptr;
+}
+
+object_t* FrameStack::DefineSlot(int slot) {
+	assert(scopes.size() > frames.back().scopes);
+	size_t index = frames.back().base + slot;
+	object_t* x = &slots[index];
+	if (x->type == OT_VOID)
+		defined.push_back(index);
+	*x = NullObject();
 	return x;
 }
 
-void VariableSpace::PushScope() {
-	registries.push_back(new VariableRegistry());
-	currentRegistry = registries.back().get();
+object_t* FrameStack::Lookup(atom_t name) {
+	// Innermost scope of the current frame first
+	size_t first = frames.back().scopes;
+	for (size_t i = scopes.size(); i > first; --i) {
+		VariableRegistry* registry = scopes[i - 1].registry.get();
+		if (registry == nullptr)
+			continue;
+		object_t* x = registry->Get(name);
+		if (x != nullptr)
+			return x;
+	}
+	return nullptr;
 }
 
-void VariableSpace::PopScope() {
-	registries.pop_back();
-	if (registries.size() == 0) {
-		assert(currentRegistry != nullptr);
-		currentRegistry = nullptr;
-	} else {
-		currentRegistry = registries.back().get();
+object_t* FrameStack::LookupGlobal(atom_t name) {
+	size_t end = (frames.size() > 1) ? frames[1].scopes : scopes.size();
+	for (size_t i = end; i > 0; --i) {
+		VariableRegistry* registry = scopes[i - 1].registry.get();
+		if (registry == nullptr)
+			continue;
+		object_t* x = registry->Get(name);
+		if (x != nullptr)
+			return x;
 	}
+	return nullptr;
+}
+
+object_t* FrameStack::Define(atom_t name) {
+	assert(scopes.size() > frames.back().scopes);
+	scope_t& scope = scopes.back();
+	if (scope.registry == nullptr)
+		scope.registry = new VariableRegistry();
+	scope.registry->Put(name, NullObject());
+	return scope.registry->Get(name);
 }
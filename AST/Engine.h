@@ -5,6 +5,8 @@
 #include "AST.h"
 #include "Dict.h"
 #include "Symbol.h"
+#include "Bytecode.h"
+#include "FlatProgram.h"
 
 enum objectType_t {
 	OT_INTEGER,
@@ -14,13 +16,31 @@ enum objectType_t {
 	OT_VOID
 };
 
+enum executionMode_t {
+	EXEC_AST,
+	EXEC_BYTECODE,
+	EXEC_FLAT
+};
+
 enum runtimeErrorCode_t {
-	RT_ERR_NONE
+	RT_ERR_NONE,
+	RT_ERR_CALL_DEPTH,
+	RT_ERR_CALLBACK_FAILED,
+	RT_ERR_NO_FUNCTION
+};
+
+struct runtimeError_t {
+	runtimeErrorCode_t	code;
+	string				details;
 };
 
-struct objectValue_t {
+// Script calls nest this deep unless the host sets another limit
+const size_t DEFAULT_MAX_CALL_DEPTH = 1000;
+
+// Strings are interned, so objects stay trivially copyable
+union objectValue_t {
 	int 	_int;
-	string 	_string;
+	atom_t 	_string;
 };
 
 struct object_t {
@@ -28,46 +48,167 @@ struct object_t {
 	objectValue_t	value;
 };
 
+inline object_t NullObject() {
+	object_t ret;
+	ret.type = OT_NULL;
+	ret.value._int = 0;
+	return ret;
+}
+
+inline object_t IntegerObject(int v) {
+	object_t ret;
+	ret.type = OT_INTEGER;
+	ret.value._int = v;
+	return ret;
+}
+
+inline object_t StringObject(const string& str) {
+	object_t ret;
+	ret.type = OT_STRING;
+	ret.value._string = Intern(str);
+	return ret;
+}
+
 struct callbackFailure_t {
 	int		code;
 	string	info;
 };
 
+// Arguments of a native call, read in place. Valid during the call only.
+struct argSpan_t {
+	const object_t*		data;
+	size_t				size;
+
+	const object_t& operator [] (size_t index) const {
+		assert(index < size);
+		return data[index];
+	}
+};
+
 typedef bool(*callbackFunction_t)(
 	const vector<object_t>& args,
 	object_t* ret, callbackFailure_t* failure);
 
+typedef bool(*callbackSpanFunction_t)(
+	const argSpan_t& args,
+	object_t* ret, callbackFailure_t* failure);
+
+// One of callback and spanCallback is set. The span form is passed the
+// arguments where they were evaluated, the vector form gets a copy.
 struct callback_t {
-	string				name;
-	size_t				parameters;
-	callbackFunction_t	callback;
+	string					name;
+	size_t					parameters;
+	callbackFunction_t		callback;
+	callbackSpanFunction_t	spanCallback;
+};
+
+// What a call site resolved to, valid while epoch matches the engine's
+struct callCache_t {
+	uint32_t			epoch;
+	ASTFuncDef*			function;
+	const callback_t*	callback;
 };
 
 class CallbackRegistry : public virtual RefObject,
-	public Dict<string, callback_t> {
+	public Dict<atom_t, callback_t> {
 };
 
 class VariableRegistry : public virtual RefObject,
-	public Dict<string, object_t> {
+	public Dict<atom_t, object_t> {
 };
 
 typedef Ref<CallbackRegistry> CallbackRegistryRef;
 typedef Ref<VariableRegistry> VariableRegistryRef;
 
-class VariableSpace : public virtual RefObject {
+// Everything an execution reads: the tree, its functions, the callbacks
+// it can call and the form it runs in. Built by Engine::Load and never
+// changed after, so any number of Engines can run one Program at the
+// same time, each on its own thread. Executing takes no references, the
+// host only has to keep one until the last execution returns. The tree
+// must not be rewritten while a Program built from it is in use. One
+// loaded from compiled code alone has no tree and runs as bytecode.
+class Program : public virtual RefObject {
+private:
+	friend class Engine;
+	ASTProgramRef				ast;
+	CallbackRegistryRef			callbacks;
+	Dict<atom_t, ASTFuncDef*>	functions;
+	// Position of each function among the definitions, its index in
+	// the flat layout and one less than its index in the bytecode
+	Dict<atom_t, int>			definitions;
+	BytecodeProgramRef			code;
+	FlatProgramRef				flat;
+	executionMode_t				mode;
+public:
+	ASTProgram* AST() const {
+		return ast.get();
+	}
+
+	const BytecodeProgram* Code() const {
+		return code.get();
+	}
+
+	executionMode_t ExecutionMode() const {
+		return mode;
+	}
+};
+
+typedef Ref<Program> ProgramRef;
+
+// Variables of every active call in one block that is reused from call
+// to call. Frames and scopes are marks into it, so entering either does
+// not allocate once the stack has grown to the deepest call.
+class FrameStack {
 private:
-	vector<VariableRegistryRef> registries;
-	VariableRegistry* currentRegistry;
+	struct frame_t {
+		size_t				base;
+		size_t				scopes;
+	};
+	struct scope_t {
+		size_t				defined;
+		// Variables without a slot, created on first use
+		VariableRegistryRef	registry;
+	};
+	// Resolved variables, undefined slots hold OT_VOID
+	vector<object_t>		slots;
+	vector<size_t>			defined;
+	vector<scope_t>			scopes;
+	vector<frame_t>			frames;
 public:
-	VariableSpace();
-	object_t*	Lookup(const string& name);
-	object_t*	Assign(const string& name, const object_t& value);
-	object_t*	Define(const string& name);
+	void		PushFrame(size_t numSlots);
+	void		PopFrame();
 	void		PushScope();
 	void		PopScope();
+	size_t		NumFrames() const;
+
+	// Lay out a frame above the current one without entering it, so the
+	// caller can evaluate arguments into it. Calls made meanwhile stack
+	// their frames above it.
+	size_t		ReserveFrame(size_t numSlots);
+	// Empty the current frame and size it for another function
+	void		ResetFrame(size_t numSlots);
+	void		EnterFrame(size_t base);
+	void		ReleaseFrame(size_t base);
+	object_t*	At(size_t index);
+
+	// Slots of the current frame, or of the global frame
+	object_t*	Slot(int slot);
+	object_t*	GlobalSlot(int slot);
+	object_t*	DefineSlot(int slot);
+
+	// Variables by name, in the current frame or the global frame
+	object_t*	Lookup(atom_t name);
+	object_t*	LookupGlobal(atom_t name);
+	object_t*	Define(atom_t name);
 };
 
-typedef Ref<VariableSpace> VariableSpaceRef;
+struct vmFrame_t {
+	const bytecodeFunction_t*	function;
+	size_t						base;
+	size_t						pc;
+	size_t						ret;
+	size_t						defines;
+};
 
 enum flag_t {
 	F_NONE		= 0x00,
@@ -77,29 +218,75 @@ enum flag_t {
 	F_EXCEPTION = 0x08
 };
 
+// The state of one execution at a time. An Engine is not shared between
+// threads, the Program it runs can be.
 class Engine {
 protected:
-	vector<VariableSpaceRef>	variableSpaces;
+	FrameStack					frames;
 	CallbackRegistryRef			callbacks;
-	Dict<string, ASTFuncDef*>	functions;
-	VariableSpace*				globalVariableSpace;
-	VariableSpace*				currentVariableSpace;
+	// Program being executed
+	const Program*				current;
+	vector<callCache_t>			callCaches;
+	// Kept from run to run, so a reused Engine does not allocate
+	vector<object_t>			vmRegisters;
+	vector<size_t>				vmDefines;
+	vector<vmFrame_t>			vmFrames;
+	vector<const callback_t*>	vmNatives;
+	// Arguments of native calls and of a pending tail call, and the
+	// operands of expressions in EXEC_FLAT
+	vector<object_t>			argumentStack;
+	ASTFuncDef*					tailCall;
+	int							tailFunction;
+	size_t						tailArguments;
+	// Program being walked in EXEC_FLAT, callbacks by site
+	const FlatProgram*			flat;
+	vector<const callback_t*>	flatCallbacks;
+	// Operators of the additive chains being evaluated
+	vector<ASTNode*>			additiveStack;
+	size_t						callDepth;
+	size_t						maxCallDepth;
+	runtimeError_t				error;
+	uint32_t					epoch;
 	flag_t						flags;
+	executionMode_t				mode;
 protected:
 	bool Executing() const;
 	bool Test(flag_t flag) const;
 	void Set(flag_t flag);
 	void Clear(flag_t flag);
+	void _Error(runtimeErrorCode_t code, const string& details);
+	void _NoFunction(atom_t name, size_t numArgs);
+	void _Reset();
+	void _Begin(const Program* program);
 protected:
 	void _PushScope();
 	void _PopScope();
-	object_t*	_VariableAssign(const string& name, const object_t& value);
-	object_t*	_VariableLookup(const string& name);
-	void _PushSpace();
-	void _PopSpace();
-	object_t	_Invoke(const string& name, const vector<object_t>& args);
-	object_t	_InvokeCallback(const string& name, const vector<object_t>& args);
-	void _PopulateFunctions(ASTProgram* program);
+	object_t*	_VariableAssign(atom_t name, const object_t& value);
+	object_t*	_VariableAssign(const ASTIdentifier* ident, const object_t& value);
+	object_t*	_VariableLookup(atom_t name);
+	object_t*	_VariableLookup(const ASTIdentifier* ident);
+	object_t*	_SlotLookup(int slot, int globalSlot);
+	void _PushFrame(size_t numSlots);
+	void _PopFrame();
+	object_t	_Invoke(ASTFuncDef* func, size_t base);
+	object_t	_Invoke(ASTFuncDef* func, const argSpan_t& args);
+	object_t	_InvokeCallback(const callback_t* callback, const argSpan_t& args);
+	bool		_TailCall(ASTCall* node);
+	void		_BindTailArguments(ASTFuncDef* func, size_t base);
+	callCache_t	_ResolveCall(ASTCall* node);
+	void _InvalidateCalls();
+	// Each runs the top level statements, or the entry function alone
+	object_t	_Interpret(ASTProgram* program, ASTFuncDef* entry, const argSpan_t& args);
+	object_t	_Run(const BytecodeProgram* code, size_t entry, const argSpan_t& args);
+	object_t	_Walk(const FlatProgram* program, int entry, const argSpan_t& args);
+	object_t	_ExecuteAdditive(ASTNode* node);
+	object_t	_Eval(uint32_t node);
+	object_t	_EvalExpression(uint32_t node);
+	object_t	_EvalLeaf(uint32_t node);
+	void		_EvalRange(uint32_t first, uint32_t end);
+	object_t	_EvalCall(uint32_t node, size_t args);
+	object_t	_EvalInvoke(int function, size_t base);
+	bool		_EvalTailCall(uint32_t node);
 protected:
 	object_t Execute(ASTNode* node);
 	object_t Execute(ASTAssign* node);
@@ -116,13 +303,53 @@ protected:
 	object_t Execute(ASTBreak* node);
 	object_t Execute(ASTReturn* node);
 	object_t Execute(ASTNot* node);
+	object_t Execute(ASTAddAssignConst* node);
+	object_t Execute(ASTWhileVarNonZero* node);
+	object_t Execute(ASTNotSubConst* node);
 public:
 	Engine();
 	~Engine();
 
 	void DefineCallback(const string& name, size_t numParams, callbackFunction_t func);
+	void DefineCallback(const string& name, size_t numParams, callbackSpanFunction_t func);
 	void DefineCallback(const callback_t& callback);
+	// Mode of the Programs loaded from now on
+	void SetExecutionMode(executionMode_t m);
+	executionMode_t ExecutionMode() const;
+
+	// Exceeding the limit stops execution with RT_ERR_CALL_DEPTH. Tail
+	// calls do not count. In EXEC_AST every level costs native stack, in
+	// EXEC_BYTECODE frames are kept on the heap and it can be set higher.
+	void SetMaxCallDepth(size_t depth);
+	size_t MaxCallDepth() const;
+
+	// Errors stop execution, the error of the last run is kept
+	bool HasError() const;
+	runtimeError_t Error() const;
+
+	// Prepares a parsed program to run in the current execution mode
+	// with the callbacks defined so far. The Program takes a reference
+	// to the tree, and references are not atomic, so one tree is loaded
+	// on one thread at a time.
+	ProgramRef Load(ASTProgram* program) const;
+	// Prepares compiled code, such as a BytecodeCache loaded, to run as
+	// bytecode. Null when it calls a callback that is not defined, or
+	// with other parameters.
+	ProgramRef Load(BytecodeProgram* code) const;
+
+	// Runs a loaded Program. Only this one is safe to call from several
+	// Engines on the same Program at once.
+	void Execute(const Program* program);
+	// Loads the tree and runs it, taking a reference to the tree as Load
+	// does. Engines on other threads must not share the tree.
 	void Execute(ASTProgram* program);
+
+	// Runs one function of the program with the given arguments and
+	// returns its result, without running the top level statements, so
+	// globals start undefined. A missing function, or one taking another
+	// number of arguments, fails with RT_ERR_NO_FUNCTION.
+	object_t Call(const Program* program, atom_t function, const argSpan_t& args);
+	object_t Call(const Program* program, const string& function, const argSpan_t& args);
 };
 
 #endif // __ENGINE_H__
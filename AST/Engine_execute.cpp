@@ -1,12 +1,6 @@
 #include "Engine.h"
-
-static object_t NullObject() {
-	object_t ret;
-	ret.type = OT_NULL;
-	ret.value._string = "null";
-	ret.value._int = 0;
-	return ret;
-}
+#include "Compiler.h"
+#include "Flattener.h"
 
 object_t Engine::Execute(ASTNode* node) {
 	assert(node != nullptr);
@@ -53,6 +47,12 @@ object_t Engine::Execute(ASTNode* node) {
 			return Execute((ASTReturn*)node);
 		case AST_NOT:
 			return Execute((ASTNot*)node);
+		case AST_ADD_ASSIGN_CONST:
+			return Execute((ASTAddAssignConst*)node);
+		case AST_WHILE_VAR_NON_ZERO:
+			return Execute((ASTWhileVarNonZero*)node);
+		case AST_NOT_SUB_CONST:
+			return Execute((ASTNotSubConst*)node);
 		default:
 			assert(false);
 			break;
@@ -62,13 +62,30 @@ object_t Engine::Execute(ASTNode* node) {
 }
 
 object_t Engine::Execute(ASTNot* node) {
-	object_t result = Execute(node->Expression().get());
+	object_t result = Execute(node->Expression());
 	result.value._int = !result.value._int;
 	return result;
 }
 
+// Not of a null keeps its type, as Execute(ASTNot*) does
+object_t Engine::Execute(ASTNotSubConst* node) {
+	object_t* x = _VariableLookup(node->Identifier());
+	if (x->type == OT_INTEGER)
+		return IntegerObject(x->value._int == node->Constant());
+
+	object_t result = NullObject();
+	result.value._int = 1;
+	return result;
+}
+
 object_t Engine::Execute(ASTReturn* node) {
-	object_t result = Execute(node->Expression().get());
+	ASTNode* expression = node->Expression();
+	if (expression->Type() == AST_CALL && _TailCall((ASTCall*)expression)) {
+		Set(F_RETURN);
+		return NullObject();
+	}
+
+	object_t result = Execute(expression);
 	Set(F_RETURN);
 	return result;
 }
@@ -79,22 +96,46 @@ object_t Engine::Execute(ASTBreak* node) {
 }
 
 object_t Engine::Execute(ASTIf* node) {
-	object_t expr = Execute(node->Expression().get());
+	object_t expr = Execute(node->Expression());
+	if (Test(F_EXCEPTION))
+		return NullObject();
 	assert(expr.type == OT_INTEGER);
 	if (expr.value._int) {
-		return Execute(node->Statement().get());
+		return Execute(node->Statement());
 	}
 	return NullObject();
 }
 
 object_t Engine::Execute(ASTWhile* node) {
 	object_t result = NullObject();
-	while (!Test(F_BREAK) && !Test(F_RETURN)) {
-		object_t expr = Execute(node->Expression().get());
+	while (Executing()) {
+		object_t expr = Execute(node->Expression());
+		if (Test(F_EXCEPTION))
+			break;
 		assert(expr.type == OT_INTEGER);
 		if (expr.value._int == 0)
 			break;
-		result = Execute(node->Statement().get());
+		result = Execute(node->Statement());
+	}
+
+	Clear(F_BREAK);
+	return result;
+}
+
+object_t Engine::Execute(ASTWhileVarNonZero* node) {
+	ASTIdentifier* ident = node->Identifier();
+	ASTNode* statement = node->Statement();
+	int step = node->Step();
+
+	object_t result = NullObject();
+	while (Executing()) {
+		// Looked up every time, a call in the body can move the frame
+		object_t* x = _VariableLookup(ident);
+		x->value._int += step;
+		assert(x->type == OT_INTEGER);
+		if (x->value._int == 0)
+			break;
+		result = Execute(statement);
 	}
 
 	Clear(F_BREAK);
@@ -102,34 +143,34 @@ object_t Engine::Execute(ASTWhile* node) {
 }
 
 object_t Engine::Execute(ASTIncrement* node) {
-	ASTNodeRef child = node->Child(0);
+	ASTNode* child = node->Child(0);
 	assert(child != nullptr);
 
 	if (child->Type() != AST_IDENTIFIER) {
-		object_t r = Execute(child.get());
+		object_t r = Execute(child);
 		r.value._int++;
 		return r;
 	}
 	
-	ASTIdentifier* ident = (ASTIdentifier*)child.get();
-	object_t* ref = _VariableLookup(ident->Name());
+	ASTIdentifier* ident = (ASTIdentifier*)child;
+	object_t* ref = _VariableLookup(ident);
 	assert(ref != nullptr);
 	ref->value._int++;
 	return *ref;
 }
 
 object_t Engine::Execute(ASTDecrement* node) {
-	ASTNodeRef child = node->Child(0);
+	ASTNode* child = node->Child(0);
 	assert(child != nullptr);
 
 	if (child->Type() != AST_IDENTIFIER) {
-		object_t r = Execute(child.get());
+		object_t r = Execute(child);
 		r.value._int--;
 		return r;
 	}
 
-	ASTIdentifier* ident = (ASTIdentifier*)child.get();
-	object_t* ref = _VariableLookup(ident->Name());
+	ASTIdentifier* ident = (ASTIdentifier*)child;
+	object_t* ref = _VariableLookup(ident);
 	assert(ref != nullptr);
 	ref->value._int--;
 	return *ref;
@@ -137,61 +178,125 @@ object_t Engine::Execute(ASTDecrement* node) {
 
 object_t Engine::Execute(ASTAssign* node) {
 	assert(node->NumChildren() == 2);
-	Ref<ASTIdentifier> ident = node->LHS();
-	object_t value = Execute(node->RHS().get());
-	return *_VariableAssign(ident->Name(), value);
+	ASTIdentifier* ident = node->LHS();
+	object_t value = Execute(node->RHS());
+	return *_VariableAssign(ident, value);
+}
+
+object_t Engine::Execute(ASTAddAssignConst* node) {
+	object_t* x = _VariableLookup(node->Identifier());
+	if (x->type == OT_INTEGER)
+		x->value._int += node->Constant();
+	else
+		*x = NullObject();
+	return *x;
 }
 
 object_t Engine::Execute(ASTIntLiteral* node) {
-	object_t ret;
-	ret.type = OT_INTEGER;
-	ret.value._int = node->Value();
-	return ret;
+	return IntegerObject(node->Value());
 }
 
 object_t Engine::Execute(ASTSubtract* node) {
-	assert(node->NumChildren() == 2);
-	object_t a = Execute(node->Child(0).get());
-	object_t b = Execute(node->Child(1).get());
-
-	if (a.type == OT_INTEGER && b.type == OT_INTEGER) {
-		object_t r;
-		r.type = OT_INTEGER;
-		r.value._int = a.value._int - b.value._int;
-		return r;
-	}
-
-	return NullObject();
+	return _ExecuteAdditive(node);
 }
 
 object_t Engine::Execute(ASTAdd* node) {
+	return _ExecuteAdditive(node);
+}
 
-	assert(node->NumChildren() == 2);
-	object_t a = Execute(node->Child(0).get());
-	object_t b = Execute(node->Child(1).get());
-
-	if (a.type == OT_INTEGER && b.type == OT_INTEGER) {
-		object_t r;
-		r.type = OT_INTEGER;
-		r.value._int = a.value._int + b.value._int;
-		return r;
+// a + b - c is built as (a + b) - c, so long chains are deep on the left.
+// The operators down the left side are stacked on the heap and applied
+// on the way back up, only the right operands are evaluated recursively.
+object_t Engine::_ExecuteAdditive(ASTNode* node) {
+	size_t mark = additiveStack.size();
+	while (node->Type() == AST_ADD || node->Type() == AST_SUBTRACT) {
+		assert(node->NumChildren() == 2);
+		additiveStack.push_back(node);
+		node = node->Child(0);
 	}
 
-	return NullObject();
+	object_t a = Execute(node);
+	while (additiveStack.size() > mark) {
+		ASTNode* op = additiveStack.back();
+		additiveStack.pop_back();
+		object_t b = Execute(op->Child(1));
+
+		if (a.type == OT_INTEGER && b.type == OT_INTEGER) {
+			a = IntegerObject(op->Type() == AST_ADD ?
+				a.value._int + b.value._int :
+				a.value._int - b.value._int);
+		} else {
+			a = NullObject();
+		}
+	}
+	return a;
 }
 
 object_t Engine::Execute(ASTIdentifier* node) {
 
-	return *_VariableLookup(node->Name());
+	return *_VariableLookup(node);
 }
 
 object_t Engine::Execute(ASTCall* node) {
+	callCache_t target = _ResolveCall(node);
+	size_t numArgs = node->NumArguments();
+	object_t result;
+
+	bool found = (target.function != nullptr) ?
+		target.function->NumParameters() == numArgs :
+		target.callback != nullptr && target.callback->parameters == numArgs;
+	if (!found) {
+		_NoFunction(node->Identifier()->Atom(), numArgs);
+		return NullObject();
+	}
 
-	vector<object_t> args;
-	for (size_t i = 0; i < node->NumArguments(); ++i) {
-		args.push_back(Execute(node->Argument(i).get()));
+	if (target.function != nullptr && callDepth >= maxCallDepth) {
+		_Error(RT_ERR_CALL_DEPTH, "call depth exceeds " + to_string(maxCallDepth) +
+			" in " + node->Identifier()->Name());
+		return NullObject();
 	}
-	object_t result = _Invoke(node->Identifier()->Name(), args);
+
+	if (target.function != nullptr && target.function->NumSlots() >= 0) {
+		// Arguments are evaluated straight into the parameter slots
+		ASTFuncDef* func = target.function;
+		size_t base = frames.ReserveFrame(func->NumSlots());
+		for (size_t i = 0; i < numArgs; ++i) {
+			object_t value = Execute(node->Argument(i));
+			*frames.At(base + func->Parameter(i)->Slot()) = value;
+		}
+		if (Test(F_EXCEPTION)) {
+			frames.ReleaseFrame(base);
+			return NullObject();
+		}
+		callDepth++;
+		result = _Invoke(func, base);
+		callDepth--;
+	} else {
+		// Anything else reads them off a stack shared by all calls
+		size_t mark = argumentStack.size();
+		for (size_t i = 0; i < numArgs; ++i) {
+			object_t value = Execute(node->Argument(i));
+			argumentStack.push_back(value);
+		}
+
+		if (Test(F_EXCEPTION)) {
+			argumentStack.resize(mark);
+			return NullObject();
+		}
+
+		argSpan_t args;
+		args.data = argumentStack.data() + mark;
+		args.size = numArgs;
+		if (target.function != nullptr) {
+			callDepth++;
+			result = _Invoke(target.function, args);
+			callDepth--;
+		} else {
+			result = _InvokeCallback(target.callback, args);
+		}
+		argumentStack.resize(mark);
+	}
+
 	Clear(F_RETURN);
 	return result;
 }
@@ -201,24 +306,145 @@ object_t Engine::Execute(ASTBlock* node) {
 
 	_PushScope();
 	object_t result = NullObject();
-	for (size_t i = 0; i < node->NumChildren(); ++i) {
+	for (ASTNode* child : node->Children()) {
 		if (!Executing())
 			break;
-		result = Execute(node->Child(i).get());
+		result = Execute(child);
 	}
 	_PopScope();
 	return result;
 }
 
-void Engine::Execute(ASTProgram* program) {
-	_PopulateFunctions(program);
-	_PushSpace();
+object_t Engine::_Interpret(ASTProgram* program, ASTFuncDef* entry, const argSpan_t& args) {
+	object_t result = NullObject();
+	_PushFrame(program->NumSlots() > 0 ? program->NumSlots() : 0);
 	_PushScope();
-	for (size_t i = 0; i < program->NumChildren(); ++i) {
-		if (!Executing())
-			break;
-		Execute(program->Child(i).get());
+	if (entry == nullptr) {
+		for (ASTNode* child : program->Children()) {
+			if (!Executing())
+				break;
+			Execute(child);
+		}
+	} else if (entry->NumSlots() >= 0) {
+		size_t base = frames.ReserveFrame(entry->NumSlots());
+		for (size_t i = 0; i < args.size; ++i)
+			*frames.At(base + entry->Parameter(i)->Slot()) = args[i];
+		callDepth++;
+		result = _Invoke(entry, base);
+		callDepth--;
+	} else {
+		callDepth++;
+		result = _Invoke(entry, args);
+		callDepth--;
 	}
+	Clear(F_RETURN);
 	_PopScope();
-	_PopSpace();
+	_PopFrame();
+	return result;
+}
+
+ProgramRef Engine::Load(ASTProgram* program) const {
+	assert(program != nullptr);
+	ProgramRef loaded = new Program();
+	loaded->ast = program;
+	// A copy, so callbacks defined later do not touch running programs
+	loaded->callbacks = new CallbackRegistry(*callbacks.get());
+	loaded->mode = mode;
+
+	// Later definitions win
+	int position = 0;
+	for (ASTNode* child : program->Children()) {
+		if (child->Type() != AST_FUNC_DEF)
+			continue;
+		ASTFuncDef* func = (ASTFuncDef*)child;
+		loaded->functions.Put(func->Atom(), func);
+		loaded->definitions.Put(func->Atom(), position++);
+	}
+
+	if (mode == EXEC_FLAT) {
+		Flattener flattener;
+		loaded->flat = flattener.Flatten(program);
+	} else if (mode == EXEC_BYTECODE) {
+		Compiler compiler;
+		loaded->code = compiler.Compile(program);
+	}
+	return loaded;
+}
+
+ProgramRef Engine::Load(BytecodeProgram* code) const {
+	assert(code != nullptr);
+	assert(code->NumFunctions() > 0);
+	for (size_t i = 0; i < code->NumCallSites(); ++i) {
+		const callSite_t& site = code->CallSite(i);
+		if (site.function >= 0)
+			continue;
+		const callback_t* callback = callbacks->Get(site.name);
+		if (callback == nullptr || callback->parameters != site.numArguments)
+			return nullptr;
+	}
+
+	ProgramRef loaded = new Program();
+	loaded->callbacks = new CallbackRegistry(*callbacks.get());
+	loaded->code = code;
+	loaded->mode = EXEC_BYTECODE;
+
+	// Function 0 is the top level, definitions follow it in order
+	for (size_t i = 1; i < code->NumFunctions(); ++i)
+		loaded->definitions.Put(Intern(code->Function(i).name), static_cast<int>(i - 1));
+	return loaded;
+}
+
+void Engine::_Begin(const Program* program) {
+	assert(program != nullptr);
+	_Reset();
+	current = program;
+	_InvalidateCalls();
+	int numSites = (program->AST() != nullptr) ? program->AST()->NumCallSites() : 0;
+	// Epoch 0 is never current
+	callCaches.assign(numSites > 0 ? numSites : 0, callCache_t());
+}
+
+void Engine::Execute(const Program* program) {
+	_Begin(program);
+	argSpan_t none = { nullptr, 0 };
+	if (program->ExecutionMode() == EXEC_AST)
+		_Interpret(program->AST(), nullptr, none);
+	else if (program->ExecutionMode() == EXEC_FLAT)
+		_Walk(program->flat.get(), -1, none);
+	else
+		_Run(program->code.get(), 0, none);
+	current = nullptr;
+}
+
+void Engine::Execute(ASTProgram* program) {
+	ProgramRef loaded = Load(program);
+	Execute(loaded.get());
+}
+
+object_t Engine::Call(const Program* program, atom_t function, const argSpan_t& args) {
+	_Begin(program);
+	object_t result = NullObject();
+	// Programs loaded from code alone only know their functions as code
+	const int* position = program->definitions.Get(function);
+	bool found = position != nullptr;
+	if (found && program->ExecutionMode() == EXEC_BYTECODE)
+		found = program->code->Function(*position + 1).numParameters == args.size;
+	else if (found)
+		found = (*program->functions.Get(function))->NumParameters() == args.size;
+
+	if (!found) {
+		_NoFunction(function, args.size);
+	} else if (program->ExecutionMode() == EXEC_AST) {
+		result = _Interpret(program->AST(), *program->functions.Get(function), args);
+	} else if (program->ExecutionMode() == EXEC_FLAT) {
+		result = _Walk(program->flat.get(), *position, args);
+	} else {
+		result = _Run(program->code.get(), *position + 1, args);
+	}
+	current = nullptr;
+	return result;
+}
+
+object_t Engine::Call(const Program* program, const string& function, const argSpan_t& args) {
+	return Call(program, Intern(function), args);
 }
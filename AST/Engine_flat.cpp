@@ -0,0 +1,335 @@
+#include "Engine.h"
+
+// EXEC_FLAT walks a FlatProgram. Statements are walked by node index as
+// the interpreter walks the tree. An expression is a contiguous range of
+// nodes in post-order, which is evaluated front to back on the argument
+// stack, so arguments end up in place for the call that follows them.
+
+object_t Engine::_Walk(const FlatProgram* program, int entry, const argSpan_t& args) {
+	assert(program != nullptr);
+	flat = program;
+	flatCallbacks.assign(program->NumCallSites(), nullptr);
+
+	object_t result = NullObject();
+	uint32_t root = program->Root();
+	_PushFrame(program->NumSlots());
+	_PushScope();
+	if (entry < 0) {
+		for (size_t i = 0; i < program->NumChildren(root); ++i) {
+			if (!Executing())
+				break;
+			_Eval(program->Child(root, i));
+		}
+	} else {
+		const flatFunction_t& func = program->Function(entry);
+		assert(func.numParameters == args.size);
+		size_t base = frames.ReserveFrame(func.numSlots);
+		for (size_t i = 0; i < args.size; ++i)
+			*frames.At(base + program->ParameterSlot(func, i)) = args[i];
+		callDepth++;
+		result = _EvalInvoke(entry, base);
+		callDepth--;
+	}
+	Clear(F_RETURN);
+	_PopScope();
+	_PopFrame();
+
+	flat = nullptr;
+	return result;
+}
+
+object_t Engine::_Eval(uint32_t node) {
+	const FlatProgram* p = flat;
+	switch (p->Type(node)) {
+		case AST_BLOCK: {
+			if (!Executing()) return NullObject();
+
+			_PushScope();
+			object_t result = NullObject();
+			for (size_t i = 0; i < p->NumChildren(node); ++i) {
+				if (!Executing())
+					break;
+				result = _Eval(p->Child(node, i));
+			}
+			_PopScope();
+			return result;
+		}
+		case AST_IF: {
+			object_t expr = _Eval(p->Child(node, 0));
+			if (Test(F_EXCEPTION))
+				return NullObject();
+			assert(expr.type == OT_INTEGER);
+			if (expr.value._int)
+				return _Eval(p->Child(node, 1));
+			return NullObject();
+		}
+		case AST_WHILE: {
+			object_t result = NullObject();
+			while (Executing()) {
+				object_t expr = _Eval(p->Child(node, 0));
+				if (Test(F_EXCEPTION))
+					break;
+				assert(expr.type == OT_INTEGER);
+				if (expr.value._int == 0)
+					break;
+				result = _Eval(p->Child(node, 1));
+			}
+			Clear(F_BREAK);
+			return result;
+		}
+		case AST_WHILE_VAR_NON_ZERO: {
+			object_t result = NullObject();
+			while (Executing()) {
+				object_t* x = _SlotLookup(p->OperandA(node), p->OperandB(node));
+				x->value._int += p->OperandC(node);
+				assert(x->type == OT_INTEGER);
+				if (x->value._int == 0)
+					break;
+				result = _Eval(p->Child(node, 0));
+			}
+			Clear(F_BREAK);
+			return result;
+		}
+		case AST_BREAK:
+			Set(F_BREAK);
+			return NullObject();
+		case AST_RETURN: {
+			uint32_t expression = p->Child(node, 0);
+			if (p->Type(expression) == AST_CALL && _EvalTailCall(expression)) {
+				Set(F_RETURN);
+				return NullObject();
+			}
+			object_t result = _EvalExpression(expression);
+			Set(F_RETURN);
+			return result;
+		}
+		case AST_FUNC_DEF:
+			return NullObject();
+		// Most statements and conditions are a single node or assign one,
+		// those are evaluated without going through the argument stack.
+		// Anything deeper is left to it, so chains take no native stack.
+		case AST_ASSIGN: {
+			uint32_t child = p->Child(node, 0);
+			bool leaf = p->First(child) == child && p->Type(child) != AST_CALL;
+			object_t value = leaf ? _EvalLeaf(child) : _EvalExpression(child);
+			if (Test(F_EXCEPTION))
+				return NullObject();
+			return *_SlotLookup(p->OperandA(node), p->OperandB(node)) = value;
+		}
+		case AST_INT_LITERAL:
+		case AST_IDENTIFIER:
+		case AST_ADD_ASSIGN_CONST:
+		case AST_NOT_SUB_CONST:
+			return _EvalLeaf(node);
+		case AST_INCREMENT:
+		case AST_DECREMENT:
+			if (p->NumChildren(node) == 0)
+				return _EvalLeaf(node);
+			return _EvalExpression(node);
+		default:
+			return _EvalExpression(node);
+	}
+}
+
+object_t Engine::_EvalExpression(uint32_t node) {
+	size_t mark = argumentStack.size();
+	_EvalRange(flat->First(node), node + 1);
+	if (Test(F_EXCEPTION)) {
+		argumentStack.resize(mark);
+		return NullObject();
+	}
+
+	assert(argumentStack.size() == mark + 1);
+	object_t result = argumentStack.back();
+	argumentStack.pop_back();
+	return result;
+}
+
+// Nodes without children other than calls, which take nothing off the
+// argument stack
+object_t Engine::_EvalLeaf(uint32_t node) {
+	const FlatProgram* p = flat;
+	switch (p->Type(node)) {
+		case AST_INT_LITERAL:
+			return IntegerObject(p->OperandA(node));
+		case AST_IDENTIFIER:
+			return *_SlotLookup(p->OperandA(node), p->OperandB(node));
+		case AST_INCREMENT:
+		case AST_DECREMENT: {
+			object_t* x = _SlotLookup(p->OperandA(node), p->OperandB(node));
+			x->value._int += (p->Type(node) == AST_INCREMENT) ? 1 : -1;
+			return *x;
+		}
+		case AST_ADD_ASSIGN_CONST: {
+			object_t* x = _SlotLookup(p->OperandA(node), p->OperandB(node));
+			if (x->type == OT_INTEGER)
+				x->value._int += p->OperandC(node);
+			else
+				*x = NullObject();
+			return *x;
+		}
+		case AST_NOT_SUB_CONST: {
+			object_t* x = _SlotLookup(p->OperandA(node), p->OperandB(node));
+			if (x->type == OT_INTEGER)
+				return IntegerObject(x->value._int == p->OperandC(node));
+			object_t result = NullObject();
+			result.value._int = 1;
+			return result;
+		}
+		default:
+			assert(false);
+			return NullObject();
+	}
+}
+
+// Leaves the value of each expression in the range on the argument stack,
+// stops early on an error
+void Engine::_EvalRange(uint32_t first, uint32_t end) {
+	const FlatProgram* p = flat;
+	for (uint32_t i = first; i < end; ++i) {
+		switch (p->Type(i)) {
+			case AST_INT_LITERAL:
+			case AST_IDENTIFIER:
+			case AST_ADD_ASSIGN_CONST:
+			case AST_NOT_SUB_CONST:
+				argumentStack.push_back(_EvalLeaf(i));
+				break;
+			case AST_ASSIGN: {
+				object_t* x = _SlotLookup(p->OperandA(i), p->OperandB(i));
+				*x = argumentStack.back();
+				break;
+			}
+			case AST_ADD:
+			case AST_SUBTRACT: {
+				object_t b = argumentStack.back();
+				argumentStack.pop_back();
+				object_t& a = argumentStack.back();
+				if (a.type == OT_INTEGER && b.type == OT_INTEGER) {
+					a.value._int = (p->Type(i) == AST_ADD) ?
+						a.value._int + b.value._int :
+						a.value._int - b.value._int;
+				} else {
+					a = NullObject();
+				}
+				break;
+			}
+			case AST_NOT:
+				argumentStack.back().value._int = !argumentStack.back().value._int;
+				break;
+			case AST_INCREMENT:
+			case AST_DECREMENT:
+				if (p->NumChildren(i) == 0)
+					argumentStack.push_back(_EvalLeaf(i));
+				else
+					argumentStack.back().value._int += (p->Type(i) == AST_INCREMENT) ? 1 : -1;
+				break;
+			case AST_CALL: {
+				size_t args = argumentStack.size() - p->NumChildren(i);
+				object_t result = _EvalCall(i, args);
+				if (Test(F_EXCEPTION))
+					return;
+				argumentStack.resize(args);
+				argumentStack.push_back(result);
+				break;
+			}
+			default:
+				assert(false);
+				argumentStack.push_back(NullObject());
+				break;
+		}
+	}
+}
+
+// The arguments are the top of the argument stack from args on
+object_t Engine::_EvalCall(uint32_t node, size_t args) {
+	const FlatProgram* p = flat;
+	size_t numArgs = p->NumChildren(node);
+	int function = p->OperandA(node);
+	object_t result;
+
+	if (function < 0) {
+		int site = p->OperandB(node);
+		const callback_t* callback = flatCallbacks[site];
+		if (callback == nullptr) {
+			callback = current->callbacks->Get(p->SiteName(site));
+			if (callback == nullptr || callback->parameters != numArgs) {
+				_NoFunction(p->SiteName(site), numArgs);
+				return NullObject();
+			}
+			flatCallbacks[site] = callback;
+		}
+
+		argSpan_t span;
+		span.data = argumentStack.data() + args;
+		span.size = numArgs;
+		result = _InvokeCallback(callback, span);
+	} else {
+		const flatFunction_t& func = p->Function(function);
+		if (func.numParameters != numArgs) {
+			_NoFunction(func.name, numArgs);
+			return NullObject();
+		}
+		if (callDepth >= maxCallDepth) {
+			_Error(RT_ERR_CALL_DEPTH, "call depth exceeds " + to_string(maxCallDepth) +
+				" in " + AtomName(func.name));
+			return NullObject();
+		}
+
+		size_t base = frames.ReserveFrame(func.numSlots);
+		for (size_t i = 0; i < numArgs; ++i)
+			*frames.At(base + p->ParameterSlot(func, i)) = argumentStack[args + i];
+		callDepth++;
+		result = _EvalInvoke(function, base);
+		callDepth--;
+	}
+
+	Clear(F_RETURN);
+	return result;
+}
+
+// Runs in the frame reserved at base, and in the same frame for every
+// tail call that follows
+object_t Engine::_EvalInvoke(int function, size_t base) {
+	const FlatProgram* p = flat;
+	frames.EnterFrame(base);
+	_PushScope();
+	object_t result = _Eval(p->Function(function).body);
+	_PopScope();
+	while (tailFunction >= 0) {
+		function = tailFunction;
+		tailFunction = -1;
+		Clear(F_RETURN);
+
+		const flatFunction_t& func = p->Function(function);
+		frames.ResetFrame(func.numSlots);
+		assert(argumentStack.size() - tailArguments == func.numParameters);
+		for (size_t i = 0; i < func.numParameters; ++i)
+			*frames.At(base + p->ParameterSlot(func, i)) = argumentStack[tailArguments + i];
+		argumentStack.resize(tailArguments);
+
+		_PushScope();
+		result = _Eval(func.body);
+		_PopScope();
+	}
+	_PopFrame();
+	return result;
+}
+
+bool Engine::_EvalTailCall(uint32_t node) {
+	if (frames.NumFrames() < 2 || flat->OperandA(node) < 0)
+		return false;
+	// A call that fails is left to _EvalCall to report
+	if (flat->Function(flat->OperandA(node)).numParameters != flat->NumChildren(node))
+		return false;
+
+	size_t mark = argumentStack.size();
+	_EvalRange(flat->First(node), node);
+	if (Test(F_EXCEPTION)) {
+		argumentStack.resize(mark);
+		return true;
+	}
+
+	tailFunction = flat->OperandA(node);
+	tailArguments = mark;
+	return true;
+}
@@ -0,0 +1,255 @@
+#include "Engine.h"
+
+// Function 0 is the top level. Any other entry is called with args on
+// top of the global frame, and returning from it ends the run.
+object_t Engine::_Run(const BytecodeProgram* code, size_t entry, const argSpan_t& args) {
+	assert(code != nullptr);
+	assert(code->NumFunctions() > 0);
+	assert(entry < code->NumFunctions());
+
+	vector<object_t>&			registers = vmRegisters;
+	vector<size_t>&				defines = vmDefines;
+	vector<vmFrame_t>&			frames = vmFrames;
+	vector<const callback_t*>&	natives = vmNatives;
+	registers.clear();
+	defines.clear();
+	frames.clear();
+	natives.assign(code->NumCallSites(), nullptr);
+
+	const bytecodeFunction_t*	function = &code->Function(0);
+	size_t						base = 0;
+	size_t						pc = 0;
+
+	registers.resize(function->numRegisters);
+	for (size_t i = 0; i < function->numSlots; ++i)
+		registers[i].type = OT_VOID;
+
+	if (entry != 0) {
+		base = function->numRegisters;
+		function = &code->Function(entry);
+		assert(function->numParameters == args.size);
+		registers.resize(base + function->numRegisters);
+		for (size_t i = 0; i < args.size; ++i)
+			registers[base + i] = args[i];
+		for (size_t i = args.size; i < function->numSlots; ++i)
+			registers[base + i].type = OT_VOID;
+	}
+
+	object_t* R = &registers[base];
+
+	// Mirrors _VariableLookup: the local slot, then the global frame,
+	// otherwise the variable comes into being in the innermost scope.
+	auto Variable = [&](int slot, int global) -> object_t* {
+		object_t* x = &R[slot];
+		if (x->type != OT_VOID)
+			return x;
+		if (global >= 0 && registers[global].type != OT_VOID)
+			return &registers[global];
+		*x = NullObject();
+		defines.push_back(base + slot);
+		return x;
+	};
+
+	for (;;) {
+		const instruction_t& ins = function->instructions[pc++];
+		switch (ins.op) {
+			case OP_NOP:
+				break;
+			case OP_NULL:
+				R[ins.a] = NullObject();
+				break;
+			case OP_INT:
+				R[ins.a].type = OT_INTEGER;
+				R[ins.a].value._int = ins.b;
+				break;
+			case OP_MOVE:
+				R[ins.a] = R[ins.b];
+				break;
+			case OP_GETVAR:
+				R[ins.a] = *Variable(ins.b, ins.c);
+				break;
+			case OP_SETVAR:
+				*Variable(ins.a, ins.c) = R[ins.b];
+				break;
+			case OP_INCVAR: {
+				object_t* x = Variable(ins.b, ins.c);
+				x->value._int++;
+				R[ins.a] = *x;
+				break;
+			}
+			case OP_DECVAR: {
+				object_t* x = Variable(ins.b, ins.c);
+				x->value._int--;
+				R[ins.a] = *x;
+				break;
+			}
+			case OP_INC:
+				R[ins.a].value._int++;
+				break;
+			case OP_DEC:
+				R[ins.a].value._int--;
+				break;
+			case OP_ADD:
+				if (R[ins.b].type == OT_INTEGER && R[ins.c].type == OT_INTEGER) {
+					R[ins.a].value._int = R[ins.b].value._int + R[ins.c].value._int;
+					R[ins.a].type = OT_INTEGER;
+				} else {
+					R[ins.a] = NullObject();
+				}
+				break;
+			case OP_SUB:
+				if (R[ins.b].type == OT_INTEGER && R[ins.c].type == OT_INTEGER) {
+					R[ins.a].value._int = R[ins.b].value._int - R[ins.c].value._int;
+					R[ins.a].type = OT_INTEGER;
+				} else {
+					R[ins.a] = NullObject();
+				}
+				break;
+			case OP_NOT:
+				if (ins.a != ins.b)
+					R[ins.a] = R[ins.b];
+				R[ins.a].value._int = !R[ins.a].value._int;
+				break;
+			case OP_ENTER:
+				R[ins.a].type = OT_INTEGER;
+				R[ins.a].value._int = static_cast<int>(defines.size());
+				break;
+			case OP_LEAVE: {
+				size_t mark = static_cast<size_t>(R[ins.a].value._int);
+				while (defines.size() > mark) {
+					registers[defines.back()].type = OT_VOID;
+					defines.pop_back();
+				}
+				break;
+			}
+			case OP_JMP:
+				pc = ins.b;
+				break;
+			case OP_JMPZ:
+				assert(R[ins.a].type == OT_INTEGER);
+				if (R[ins.a].value._int == 0)
+					pc = ins.b;
+				break;
+			case OP_CALL: {
+				const callSite_t& site = code->CallSite(ins.b);
+				const bytecodeFunction_t* callee = &code->Function(site.function);
+				if (callee->numParameters != site.numArguments) {
+					_NoFunction(site.name, site.numArguments);
+					return NullObject();
+				}
+				if (frames.size() >= maxCallDepth) {
+					_Error(RT_ERR_CALL_DEPTH, "call depth exceeds " + to_string(maxCallDepth) +
+						" in " + callee->name);
+					return NullObject();
+				}
+
+				vmFrame_t frame;
+				frame.function = function;
+				frame.base = base;
+				frame.pc = pc;
+				frame.ret = base + ins.a;
+				frame.defines = defines.size();
+				frames.push_back(frame);
+
+				// Arguments are already in place at the bottom of the new frame
+				function = callee;
+				base += ins.c;
+				pc = 0;
+				if (registers.size() < base + function->numRegisters)
+					registers.resize(base + function->numRegisters);
+
+				size_t i = site.numArguments < function->numParameters ?
+					site.numArguments : function->numParameters;
+				for (; i < function->numSlots; ++i)
+					registers[base + i].type = OT_VOID;
+
+				R = &registers[base];
+				break;
+			}
+			case OP_TAILCALL: {
+				const callSite_t& site = code->CallSite(ins.b);
+				const bytecodeFunction_t* callee = &code->Function(site.function);
+				if (callee->numParameters != site.numArguments) {
+					_NoFunction(site.name, site.numArguments);
+					return NullObject();
+				}
+
+				// Variables of this call go, the arguments move down to
+				// the bottom of the frame and the callee starts over in it.
+				// An entry function defines from an empty list.
+				defines.resize(frames.empty() ? 0 : frames.back().defines);
+				for (size_t i = 0; i < site.numArguments; ++i)
+					R[i] = R[ins.c + i];
+
+				function = callee;
+				pc = 0;
+				if (registers.size() < base + function->numRegisters)
+					registers.resize(base + function->numRegisters);
+
+				for (size_t i = site.numArguments; i < function->numSlots; ++i)
+					registers[base + i].type = OT_VOID;
+
+				R = &registers[base];
+				break;
+			}
+			case OP_CALLNATIVE: {
+				const callSite_t& site = code->CallSite(ins.b);
+				const callback_t* cb = natives[ins.b];
+				if (cb == nullptr) {
+					cb = current->callbacks->Get(site.name);
+					if (cb == nullptr || cb->parameters != site.numArguments) {
+						_NoFunction(site.name, site.numArguments);
+						return NullObject();
+					}
+					natives[ins.b] = cb;
+				}
+
+				argSpan_t args;
+				args.data = R + ins.c;
+				args.size = site.numArguments;
+				R[ins.a] = _InvokeCallback(cb, args);
+				if (Test(F_EXCEPTION))
+					return NullObject();
+				break;
+			}
+			case OP_JMPBRK:
+				if (!Test(F_BREAK))
+					break;
+				if (ins.b >= 0) {
+					Clear(F_BREAK);
+					if (ins.c >= 0) {
+						size_t mark = static_cast<size_t>(R[ins.c].value._int);
+						while (defines.size() > mark) {
+							registers[defines.back()].type = OT_VOID;
+							defines.pop_back();
+						}
+					}
+					pc = ins.b;
+					break;
+				}
+				// Out of any loop the caller breaks as well
+				// fall through
+			case OP_BREAK:
+				Set(F_BREAK);
+				// fall through
+			case OP_RET: {
+				if (frames.size() == 0)
+					return R[ins.a];
+
+				vmFrame_t& frame = frames.back();
+				registers[frame.ret] = R[ins.a];
+				defines.resize(frame.defines);
+				function = frame.function;
+				base = frame.base;
+				pc = frame.pc;
+				frames.pop_back();
+
+				R = &registers[base];
+				break;
+			}
+			default:
+				assert(false);
+				return NullObject();
+		}
+	}
+}
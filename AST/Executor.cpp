@@ -0,0 +1,118 @@
+#include "Executor.h"
+
+Executor::Executor(size_t numWorkers) {
+	if (numWorkers == 0)
+		numWorkers = thread::hardware_concurrency();
+	if (numWorkers == 0)
+		numWorkers = 1;
+
+	queued = 0;
+	nextWorker = 0;
+	stopping = false;
+	for (size_t i = 0; i < numWorkers; ++i)
+		workers.push_back(new worker_t());
+	// Only once every deque exists, workers steal from all of them
+	for (size_t i = 0; i < numWorkers; ++i)
+		workers[i]->runner = thread(&Executor::_Work, this, i);
+}
+
+Executor::~Executor() {
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i]->runner.join();
+	for (size_t i = 0; i < workers.size(); ++i)
+		delete workers[i];
+}
+
+size_t Executor::NumWorkers() const {
+	return workers.size();
+}
+
+// Before any job is submitted only
+void Executor::SetMaxCallDepth(size_t depth) {
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i]->engine.SetMaxCallDepth(depth);
+}
+
+future<jobResult_t> Executor::Submit(const Program* program, atom_t function, const vector<object_t>& args) {
+	assert(program != nullptr);
+	job_t job;
+	job.program = program;
+	job.function = function;
+	job.args = args;
+	future<jobResult_t> result = job.result.get_future();
+
+	// Spread over the workers, idle ones steal what others cannot get to
+	size_t target;
+	{
+		lock_guard<mutex> guard(lock);
+		target = nextWorker;
+		nextWorker = (nextWorker + 1) % workers.size();
+		queued++;
+	}
+	{
+		lock_guard<mutex> guard(workers[target]->lock);
+		workers[target]->jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+	return result;
+}
+
+future<jobResult_t> Executor::Submit(const Program* program, const string& function, const vector<object_t>& args) {
+	return Submit(program, Intern(function), args);
+}
+
+// The newest job of our own deque, otherwise the oldest of another's
+bool Executor::_Take(size_t self, job_t* job) {
+	worker_t* own = workers[self];
+	{
+		lock_guard<mutex> guard(own->lock);
+		if (!own->jobs.empty()) {
+			*job = std::move(own->jobs.back());
+			own->jobs.pop_back();
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < workers.size(); ++i) {
+		worker_t* victim = workers[(self + i) % workers.size()];
+		lock_guard<mutex> guard(victim->lock);
+		if (!victim->jobs.empty()) {
+			*job = std::move(victim->jobs.front());
+			victim->jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void Executor::_Work(size_t self) {
+	Engine& engine = workers[self]->engine;
+	job_t job;
+	for (;;) {
+		if (!_Take(self, &job)) {
+			// A job can be counted before it is visible in a deque, so
+			// a waker that finds nothing just looks again
+			unique_lock<mutex> guard(lock);
+			wake.wait(guard, [this] { return queued > 0 || stopping; });
+			if (queued == 0 && stopping)
+				return;
+			continue;
+		}
+
+		{
+			lock_guard<mutex> guard(lock);
+			queued--;
+		}
+
+		argSpan_t args = { job.args.data(), job.args.size() };
+		jobResult_t result;
+		result.value = engine.Call(job.program, job.function, args);
+		result.error = engine.Error();
+		job.result.set_value(result);
+	}
+}
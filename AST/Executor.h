@@ -0,0 +1,60 @@
+#ifndef __EXECUTOR_H__
+#define __EXECUTOR_H__
+
+#include "Common.h"
+#include "Engine.h"
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <thread>
+
+// What a job returned, or the error that stopped it
+struct jobResult_t {
+	object_t				value;
+	runtimeError_t			error;
+};
+
+// Runs Engine::Call jobs on a fixed pool of worker threads. Every worker
+// has one Engine that it reuses for all of its jobs, and a deque of its
+// own: it takes work from the back of it, and when that runs dry steals
+// from the front of the others. Programs are not referenced by the
+// executor, the host keeps each one until its jobs have completed.
+class Executor {
+private:
+	struct job_t {
+		const Program*			program;
+		atom_t					function;
+		vector<object_t>		args;
+		promise<jobResult_t>	result;
+	};
+	struct worker_t {
+		mutex					lock;
+		deque<job_t>			jobs;
+		Engine					engine;
+		thread					runner;
+	};
+	vector<worker_t*>		workers;
+	mutex					lock;
+	condition_variable		wake;
+	// Jobs in the deques, guarded by lock
+	size_t					queued;
+	size_t					nextWorker;
+	bool					stopping;
+private:
+	bool					_Take(size_t self, job_t* job);
+	void					_Work(size_t self);
+public:
+							// Zero picks one worker per hardware thread
+							Executor(size_t numWorkers = 0);
+							// Completes every queued job first
+							~Executor();
+
+	size_t					NumWorkers() const;
+	void					SetMaxCallDepth(size_t depth);
+
+	future<jobResult_t>		Submit(const Program* program, atom_t function, const vector<object_t>& args);
+	future<jobResult_t>		Submit(const Program* program, const string& function, const vector<object_t>& args);
+};
+
+#endif // __EXECUTOR_H__
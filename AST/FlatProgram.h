@@ -0,0 +1,120 @@
+#ifndef __FLAT_PROGRAM_H__
+#define __FLAT_PROGRAM_H__
+
+#include "Common.h"
+#include "Ref.h"
+#include "Atom.h"
+#include "AST.h"
+
+// A resolved program laid out flat. Nodes are numbered in post-order, so
+// a subtree is the range of nodes from First(node) up to node and the
+// program is the last node. Types, operands and child ranges are kept in
+// separate arrays, walking them goes through no Ref and no pointers.
+//
+// Variables are given by their slots. Nodes that name a variable take
+// it as operands rather than as an identifier child:
+//   AST_INT_LITERAL				a = value
+//   AST_IDENTIFIER				a = slot, b = global slot
+//   AST_ASSIGN					a, b = variable, child is the value
+//   AST_INCREMENT/DECREMENT		a, b = variable, no child, or a child that
+//								is not a variable
+//   AST_CALL						a = function or -1 for a callback, b = site,
+//								children are the arguments
+//   AST_FUNC_DEF					a = function, child is the body, nested
+//								definitions are never run and have neither
+//   AST_ADD_ASSIGN_CONST			a, b = variable, c = constant
+//   AST_NOT_SUB_CONST			a, b = variable, c = constant
+//   AST_WHILE_VAR_NON_ZERO		a, b = variable, c = step, child is the body
+struct flatFunction_t {
+	atom_t					name;
+	int						numSlots;
+	uint32_t				body;
+	uint32_t				firstParameter;
+	uint32_t				numParameters;
+};
+
+class FlatProgram : public virtual RefObject {
+private:
+	friend class Flattener;
+	vector<uint8_t>			types;
+	vector<int>				operandA;
+	vector<int>				operandB;
+	vector<int>				operandC;
+	vector<uint32_t>		first;
+	vector<uint32_t>		firstChild;
+	vector<uint32_t>		numChildren;
+	vector<uint32_t>		children;
+	vector<flatFunction_t>	functions;
+	vector<int>				parameterSlots;
+	vector<atom_t>			siteNames;
+	int						numSlots;
+public:
+	size_t					NumNodes() const {
+		return types.size();
+	}
+
+	uint32_t				Root() const {
+		assert(types.size() > 0);
+		return static_cast<uint32_t>(types.size() - 1);
+	}
+
+	astNodeType_t			Type(uint32_t node) const {
+		return static_cast<astNodeType_t>(types[node]);
+	}
+
+	int						OperandA(uint32_t node) const {
+		return operandA[node];
+	}
+
+	int						OperandB(uint32_t node) const {
+		return operandB[node];
+	}
+
+	int						OperandC(uint32_t node) const {
+		return operandC[node];
+	}
+
+	// First node of the subtree rooted at node
+	uint32_t				First(uint32_t node) const {
+		return first[node];
+	}
+
+	size_t					NumChildren(uint32_t node) const {
+		return numChildren[node];
+	}
+
+	uint32_t				Child(uint32_t node, size_t index) const {
+		assert(index < numChildren[node]);
+		return children[firstChild[node] + index];
+	}
+
+	size_t					NumFunctions() const {
+		return functions.size();
+	}
+
+	const flatFunction_t&	Function(size_t index) const {
+		return functions[index];
+	}
+
+	int						ParameterSlot(const flatFunction_t& function, size_t index) const {
+		assert(index < function.numParameters);
+		return parameterSlots[function.firstParameter + index];
+	}
+
+	size_t					NumCallSites() const {
+		return siteNames.size();
+	}
+
+	atom_t					SiteName(size_t site) const {
+		return siteNames[site];
+	}
+
+	// Size of the global frame
+	int						NumSlots() const {
+		return numSlots;
+	}
+};
+
+typedef Ref<FlatProgram> FlatProgramRef;
+
+#endif // __FLAT_PROGRAM_H__
@@ -0,0 +1,175 @@
+#include "Flattener.h"
+
+Flattener::Flattener() {
+	nextFunction = 0;
+}
+
+Flattener::~Flattener() {
+}
+
+// Whether child index of node gets a node of its own. Identifiers naming
+// the variable of a node become its operands, call names go to the site
+// table and parameters to the function table.
+bool Flattener::_Flattens(ASTNode* node, size_t index, bool topLevel) {
+	switch (node->Type()) {
+		case AST_CALL:
+			return index > 0;
+		case AST_ASSIGN:
+			return index == 1;
+		case AST_INCREMENT:
+		case AST_DECREMENT:
+			return node->Child(0)->Type() != AST_IDENTIFIER;
+		case AST_FUNC_DEF:
+			return topLevel && index == 0;
+		case AST_WHILE_VAR_NON_ZERO:
+			return index == 1;
+		case AST_ADD_ASSIGN_CONST:
+		case AST_NOT_SUB_CONST:
+			return false;
+		default:
+			return true;
+	}
+}
+
+void Flattener::_Variable(ASTIdentifier* ident, int* slot, int* globalSlot) {
+	assert(ident->Slot() >= 0);
+	*slot = ident->Slot();
+	*globalSlot = ident->GlobalSlot();
+}
+
+// Later definitions of a name win as they do in the interpreter
+void Flattener::_AddFunction(ASTFuncDef* node) {
+	assert(node->NumSlots() >= 0);
+	flatFunction_t function;
+	function.name = node->Atom();
+	function.numSlots = node->NumSlots();
+	function.body = 0;
+	function.firstParameter = static_cast<uint32_t>(program->parameterSlots.size());
+	function.numParameters = static_cast<uint32_t>(node->NumParameters());
+	for (size_t i = 0; i < node->NumParameters(); ++i)
+		program->parameterSlots.push_back(node->Parameter(i)->Slot());
+
+	functionIndices.Put(function.name, static_cast<int>(program->functions.size()));
+	program->functions.push_back(function);
+}
+
+uint32_t Flattener::_Emit(const pending_t& entry) {
+	FlatProgram* p = program.get();
+	ASTNode* node = entry.node;
+	uint32_t index = static_cast<uint32_t>(p->types.size());
+	size_t count = flattened.size() - entry.mark;
+
+	int a = 0;
+	int b = 0;
+	int c = 0;
+	switch (node->Type()) {
+		case AST_INT_LITERAL:
+			a = ((ASTIntLiteral*)node)->Value();
+			break;
+		case AST_IDENTIFIER:
+			_Variable((ASTIdentifier*)node, &a, &b);
+			break;
+		case AST_ASSIGN:
+			_Variable(((ASTAssign*)node)->LHS(), &a, &b);
+			break;
+		case AST_INCREMENT:
+		case AST_DECREMENT:
+			if (count == 0)
+				_Variable((ASTIdentifier*)node->Child(0), &a, &b);
+			break;
+		case AST_CALL: {
+			ASTCall* call = (ASTCall*)node;
+			atom_t name = call->Identifier()->Atom();
+			const int* function = functionIndices.Get(name);
+			assert(call->Site() >= 0);
+			a = (function != nullptr) ? *function : -1;
+			b = call->Site();
+			p->siteNames[b] = name;
+			break;
+		}
+		case AST_FUNC_DEF:
+			a = -1;
+			if (entry.topLevel) {
+				a = static_cast<int>(nextFunction++);
+				p->functions[a].body = flattened[entry.mark];
+			}
+			break;
+		case AST_ADD_ASSIGN_CONST:
+			_Variable(((ASTAddAssignConst*)node)->Identifier(), &a, &b);
+			c = ((ASTAddAssignConst*)node)->Constant();
+			break;
+		case AST_NOT_SUB_CONST:
+			_Variable(((ASTNotSubConst*)node)->Identifier(), &a, &b);
+			c = ((ASTNotSubConst*)node)->Constant();
+			break;
+		case AST_WHILE_VAR_NON_ZERO:
+			_Variable(((ASTWhileVarNonZero*)node)->Identifier(), &a, &b);
+			c = ((ASTWhileVarNonZero*)node)->Step();
+			break;
+		default:
+			break;
+	}
+
+	p->types.push_back(static_cast<uint8_t>(node->Type()));
+	p->operandA.push_back(a);
+	p->operandB.push_back(b);
+	p->operandC.push_back(c);
+	p->first.push_back(count > 0 ? p->first[flattened[entry.mark]] : index);
+	p->firstChild.push_back(static_cast<uint32_t>(p->children.size()));
+	p->numChildren.push_back(static_cast<uint32_t>(count));
+	p->children.insert(p->children.end(), flattened.begin() + entry.mark, flattened.end());
+	return index;
+}
+
+FlatProgramRef Flattener::Flatten(ASTProgram* node) {
+	assert(node != nullptr);
+	assert(node->NumSlots() >= 0);
+	assert(node->NumCallSites() >= 0);
+	program = new FlatProgram();
+	program->numSlots = node->NumSlots();
+	program->siteNames.resize(node->NumCallSites(), ATOM_NONE);
+	functionIndices.Clear();
+	nextFunction = 0;
+
+	// Calls can name functions defined further down
+	for (size_t i = 0; i < node->NumChildren(); ++i) {
+		ASTNode* child = node->Child(i);
+		if (child->Type() == AST_FUNC_DEF)
+			_AddFunction((ASTFuncDef*)child);
+	}
+
+	pending_t root;
+	root.node = node;
+	root.next = 0;
+	root.mark = 0;
+	root.topLevel = false;
+	pending.push_back(root);
+
+	while (!pending.empty()) {
+		pending_t& top = pending.back();
+		if (top.next < top.node->NumChildren()) {
+			size_t i = top.next++;
+			if (!_Flattens(top.node, i, top.topLevel))
+				continue;
+
+			pending_t child;
+			child.node = top.node->Child(i);
+			child.next = 0;
+			child.mark = flattened.size();
+			child.topLevel = (top.node->Type() == AST_PROGRAM);
+			pending.push_back(child);
+			continue;
+		}
+
+		uint32_t index = _Emit(top);
+		flattened.resize(top.mark);
+		pending.pop_back();
+		flattened.push_back(index);
+	}
+
+	assert(nextFunction == program->functions.size());
+	flattened.clear();
+	FlatProgramRef result = program;
+	program = nullptr;
+	return result;
+}
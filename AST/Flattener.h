@@ -0,0 +1,37 @@
+#ifndef __FLATTENER_H__
+#define __FLATTENER_H__
+
+#include "Common.h"
+#include "AST.h"
+#include "Dict.h"
+#include "FlatProgram.h"
+
+// Lays a resolved program out as a FlatProgram. The tree is walked with
+// an explicit stack, so deep trees do not recurse.
+class Flattener {
+private:
+	struct pending_t {
+		ASTNode*			node;
+		size_t				next;
+		size_t				mark;
+		bool				topLevel;
+	};
+	FlatProgramRef			program;
+	Dict<atom_t, int>		functionIndices;
+	vector<pending_t>		pending;
+	// Nodes laid out whose parent is not yet
+	vector<uint32_t>		flattened;
+	size_t					nextFunction;
+private:
+	static bool				_Flattens(ASTNode* node, size_t index, bool topLevel);
+	static void				_Variable(ASTIdentifier* ident, int* slot, int* globalSlot);
+	void					_AddFunction(ASTFuncDef* node);
+	uint32_t				_Emit(const pending_t& entry);
+public:
+							Flattener();
+							~Flattener();
+
+	FlatProgramRef			Flatten(ASTProgram* node);
+};
+
+#endif // __FLATTENER_H__
@@ -0,0 +1,136 @@
+#include "Fuser.h"
+
+// Integer arithmetic wraps, as it does when executed
+static int WrapNeg(int a) {
+	return static_cast<int>(0u - static_cast<unsigned int>(a));
+}
+
+// Matches x + k and x - k, giving x and the k that is added
+static bool MatchVarConst(ASTNode* node, ASTIdentifier** ident, int* k) {
+	if (node->Type() != AST_ADD && node->Type() != AST_SUBTRACT)
+		return false;
+
+	ASTNode* a = node->Child(0);
+	ASTNode* b = node->Child(1);
+	if (a->Type() != AST_IDENTIFIER || b->Type() != AST_INT_LITERAL)
+		return false;
+
+	int value = ((ASTIntLiteral*)b)->Value();
+	*ident = (ASTIdentifier*)a;
+	*k = (node->Type() == AST_ADD) ? value : WrapNeg(value);
+	return true;
+}
+
+// Two uses of a name that resolve to the same variable
+static bool SameVariable(ASTIdentifier* a, ASTIdentifier* b) {
+	return (
+		a->Atom() == b->Atom() &&
+		a->Slot() == b->Slot() &&
+		a->GlobalSlot() == b->GlobalSlot()
+		);
+}
+
+Fuser::Fuser() {
+	arena = nullptr;
+	counts.addAssignConst = 0;
+	counts.whileVarNonZero = 0;
+	counts.notSubConst = 0;
+}
+
+Fuser::~Fuser() {
+}
+
+ASTNodeRef Fuser::_Fuse(ASTNode* node) {
+	if (node->Type() == AST_ADD || node->Type() == AST_SUBTRACT)
+		return _FuseChain(node);
+
+	for (size_t i = 0; i < node->NumChildren(); ++i) {
+		ASTNodeRef child = node->Child(i);
+		ASTNodeRef result = _Fuse(child.get());
+		if (result != child.get())
+			node->ReplaceChild(i, result);
+	}
+
+	switch (node->Type()) {
+		case AST_ASSIGN:
+			return _Fuse((ASTAssign*)node);
+		case AST_WHILE:
+			return _Fuse((ASTWhile*)node);
+		case AST_NOT:
+			return _Fuse((ASTNot*)node);
+		default:
+			return node;
+	}
+}
+
+// A chain is never fused itself, only its operands are. It is walked
+// down its left side rather than recursed into, as chains are deep there.
+ASTNodeRef Fuser::_FuseChain(ASTNode* node) {
+	vector<ASTNode*> chain;
+	ASTNode* term = node;
+	while (term->Type() == AST_ADD || term->Type() == AST_SUBTRACT) {
+		chain.push_back(term);
+		term = term->Child(0);
+	}
+
+	ASTNodeRef result = _Fuse(term);
+	if (result != term)
+		chain.back()->ReplaceChild(0, result);
+
+	for (size_t i = 0; i < chain.size(); ++i) {
+		ASTNodeRef rhs = chain[i]->Child(1);
+		result = _Fuse(rhs.get());
+		if (result != rhs.get())
+			chain[i]->ReplaceChild(1, result);
+	}
+	return node;
+}
+
+ASTNodeRef Fuser::_Fuse(ASTAssign* node) {
+	ASTIdentifierRef lhs = node->LHS();
+	ASTIdentifier* ident = nullptr;
+	int k = 0;
+	if (!MatchVarConst(node->RHS(), &ident, &k) || !SameVariable(lhs.get(), ident))
+		return node;
+
+	counts.addAssignConst++;
+	return ASTNew<ASTAddAssignConst>(arena, lhs, k);
+}
+
+ASTNodeRef Fuser::_Fuse(ASTWhile* node) {
+	ASTNodeRef test = node->Expression();
+	int step = 0;
+	if (test->Type() == AST_DECREMENT || test->Type() == AST_INCREMENT) {
+		step = (test->Type() == AST_DECREMENT) ? -1 : 1;
+		test = test->Child(0);
+	}
+
+	if (test->Type() != AST_IDENTIFIER)
+		return node;
+
+	counts.whileVarNonZero++;
+	ASTIdentifierRef ident = (ASTIdentifier*)test.get();
+	return ASTNew<ASTWhileVarNonZero>(arena, ident, node->Statement(), step);
+}
+
+ASTNodeRef Fuser::_Fuse(ASTNot* node) {
+	ASTIdentifier* ident = nullptr;
+	int k = 0;
+	if (!MatchVarConst(node->Expression(), &ident, &k))
+		return node;
+
+	// x - c tests x against c, x + c against -c
+	counts.notSubConst++;
+	return ASTNew<ASTNotSubConst>(arena, ASTIdentifierRef(ident), WrapNeg(k));
+}
+
+fuseCounts_t Fuser::Fuse(ASTProgram* program) {
+	assert(program != nullptr);
+	assert(program->NumSlots() >= 0);
+	arena = program->Memory();
+
+	_Fuse(program);
+
+	arena = nullptr;
+	return counts;
+}
@@ -0,0 +1,36 @@
+#ifndef __FUSER_H__
+#define __FUSER_H__
+
+#include "Common.h"
+#include "AST.h"
+
+// How many of each fused form a program was given
+struct fuseCounts_t {
+	size_t					addAssignConst;
+	size_t					whileVarNonZero;
+	size_t					notSubConst;
+};
+
+// Replaces small shapes that scripts repeat with one fused node each,
+// so the interpreter runs them in a single step and a single variable
+// lookup. Runs on a resolved program, after the Optimizer has brought
+// literals to the right.
+class Fuser {
+private:
+	Arena*					arena;
+	fuseCounts_t			counts;
+private:
+	ASTNodeRef				_Fuse(ASTNode* node);
+	ASTNodeRef				_FuseChain(ASTNode* node);
+	ASTNodeRef				_Fuse(ASTAssign* node);
+	ASTNodeRef				_Fuse(ASTWhile* node);
+	ASTNodeRef				_Fuse(ASTNot* node);
+public:
+							Fuser();
+							~Fuser();
+
+	// Rewrite in place, returns how often each form was put in
+	fuseCounts_t			Fuse(ASTProgram* program);
+};
+
+#endif // __FUSER_H__
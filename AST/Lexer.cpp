@@ -1,41 +1,63 @@
 #include "Lexer.h"
-#include "Char.h"
-
-//#ifdef _DEBUG
-#if 0
-#define DEBUG_TRACE(X) { printf(X); printf("\n"); }
-#else
-#define DEBUG_TRACE(X)
-#endif
-
-Lexer::Lexer(const char * inp) : input(inp) {
-	assert(input != nullptr);
-	inputLength = static_cast<int>(strlen(input));
-	line = 0;
-	value.clear();
-	head = -1;
-	Advance();
-}
-
-Lexer::~Lexer() {
-}
+#include <cstring>
+
+enum charClass_t {
+	CHAR_WHITE = 1,
+	CHAR_ALPHA = 2,
+	CHAR_DIGIT = 4,
+	CHAR_IDENTIFIER = 8
+};
+
+// Character classes indexed by byte, so the scanning loops are a table
+// lookup rather than a chain of comparisons
+struct charTable_t {
+	unsigned char classes[256];
+
+	charTable_t() {
+		for (int c = 0; c < 256; ++c) {
+			unsigned char cls = 0;
+			if (c == ' ' || c == '\t' || c == '\n' || c == 0x0b || c == 0x0c || c == '\r')
+				cls |= CHAR_WHITE;
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))
+				cls |= CHAR_ALPHA | CHAR_IDENTIFIER;
+			if (c >= '0' && c <= '9')
+				cls |= CHAR_DIGIT | CHAR_IDENTIFIER;
+			if (c == '_')
+				cls |= CHAR_IDENTIFIER;
+			classes[c] = cls;
+		}
+	}
+};
 
-void Lexer::_ClearToken() {
-	tok.type = TOK_EOF;
-	tok.value.clear();
-}
+static const charTable_t charTable;
 
-void Lexer::_Push(char c) {
-	value.push_back(c);
+static tokenType_t KeywordType(const char* s, int length) {
+	switch (length) {
+		case 2:
+			if (memcmp(s, "if", 2) == 0) return TOK_IF;
+			break;
+		case 5:
+			if (memcmp(s, "while", 5) == 0) return TOK_WHILE;
+			if (memcmp(s, "break", 5) == 0) return TOK_BREAK;
+			break;
+		case 6:
+			if (memcmp(s, "return", 6) == 0) return TOK_RETURN;
+			break;
+		case 8:
+			if (memcmp(s, "function", 8) == 0) return TOK_FUNCTION;
+			break;
+	}
+	return TOK_IDENTIFIER;
 }
 
-void Lexer::_Pop() {
-	if (value.size() > 0)
-		value.pop_back();
+Lexer::Lexer(const SourceRef& src) : source(src) {
+	assert(source != nullptr);
+	input = source->Data();
+	inputLength = static_cast<int>(source->Length());
+	Reset();
 }
 
-void Lexer::_Clear() {
-	value.clear();
+Lexer::~Lexer() {
 }
 
 int Lexer::Line() const {
@@ -46,325 +68,135 @@ int Lexer::Head() const {
 	return head;
 }
 
-token_t Lexer::Token() const {
+const token_t& Lexer::Token() const {
 	return tok;
 }
 
-void Lexer::Restore(int where) {
-	while (head > where) {
-		_Pop();
-		head--;
-		look = input[head];
-		if (IsVerticalWhite(look)) {
-			line--;
-		}
-	}
-	assert(head == where);
-	assert(look == input[head]);
-}
-
-void Lexer::Restore(int where, token_t reset) {
-	Restore(where);
-	tok = reset;
-}
-
-void Lexer::Advance() {
-	if (head < inputLength) {
-		_Push(look);
-		if (IsVerticalWhite(look)) {
-			line++;
-		}
-		head++;
-		look = input[head];
-	}
-}
-
-bool Lexer::Match(char c) {
-	if (look == c) {
-		Advance();
-		return true;
-	}
-	return false;
-}
-
-bool Lexer::MatchAlpha() {
-	if (IsAlpha(look)) {
-		Advance();
-		return true;
-	}
-	return false;
-}
-
-bool Lexer::MatchAlphaNum() {
-	if (IsAlphaNumeric(look)) {
-		Advance();
-		return true;
-	}
-	return false;
-}
-
-bool Lexer::MatchWhite() {
-	if (IsWhite(look)) {
-		Advance();
-		return true;
-	}
-	return false;
-}
-
-bool Lexer::MatchVerticalWhite() {
-	if (IsVerticalWhite(look)) {
-		Advance();
-		return true;
-	}
-	return false;
-}
-
-bool Lexer::MatchDecimalDigit() {
-	if (IsDigit(look)) {
-		Advance();
-		return true;
-	}
-	return false;
-}
-
-bool Lexer::MatchDecimalInteger() {
-	if (MatchDecimalDigit()) {
-		while (MatchDecimalDigit()) {
-		}
-		return true;
-	}
-	return false;
-}
-
-bool Lexer::MatchIdentifier() {
-	if (!MatchAlpha())
-		return false;
-
-	while (
-		MatchAlphaNum() ||
-		Match('_')) {
-	}
-
-	return true;
-}
-
-bool Lexer::Match(const char* str) {
-	int i = 0;
-	int len = static_cast<int>(strlen(str));
-	for (int i = 0; i < len; ++i) {
-		if (!Match(str[i])) {
-			return false;
-		}
-	}
-	return true;
+const char* Lexer::Lexeme(const token_t& token) const {
+	return input + token.offset;
 }
 
-bool Lexer::MatchKeyword(const char* str) {
-	if (!Match(str))
-		return false;
-
-	if (IsAlphaNumeric(look)) {
-		return false;
-	}
-
-	return true;
+string Lexer::Text(const token_t& token) const {
+	return source->Text(token.offset, token.length);
 }
 
-bool Lexer::MatchLineComment() {
-	if (Match("//")) {
-		while (!MatchVerticalWhite()) {
-			Advance();
+void Lexer::Reset() {
+	head = 0;
+	line = 0;
+	lineStart = 0;
+	tok.type = TOK_EOF;
+	tok.offset = 0;
+	tok.length = 0;
+	tok.line = 0;
+	tok.column = 0;
+	tok.atom = ATOM_NONE;
+}
+
+lexerState_t Lexer::State() const {
+	lexerState_t state;
+	state.head = head;
+	state.line = line;
+	state.lineStart = lineStart;
+	state.tok = tok;
+	return state;
+}
+
+void Lexer::Restore(const lexerState_t& state) {
+	assert(state.head >= 0 && state.head <= inputLength);
+	head = state.head;
+	line = state.line;
+	lineStart = state.lineStart;
+	tok = state.tok;
+}
+
+void Lexer::_SkipWhite() {
+	const unsigned char* classes = charTable.classes;
+	while (head < inputLength) {
+		char c = input[head];
+		if (classes[(unsigned char)c] & CHAR_WHITE) {
+			head++;
+			if (c == '\n') {
+				line++;
+				lineStart = head;
+			}
+		} else if (c == '/' && head + 1 < inputLength && input[head + 1] == '/') {
+			// Line comment, the newline is left for the next iteration
+			head += 2;
+			while (head < inputLength && input[head] != '\n' && input[head] != '\r')
+				head++;
+		} else {
+			break;
 		}
-		return true;
 	}
-	return false;
 }
 
 void Lexer::AdvanceToken() {
+	const unsigned char* classes = charTable.classes;
+	_SkipWhite();
 
-	do {
-		while (MatchLineComment()) {}
-	} while (MatchWhite());
-
-	_Clear();
-
-	int tmp = head;
+	int start = head;
+	tok.atom = ATOM_NONE;
 
 	if (head >= inputLength) {
 		tok.type = TOK_EOF;
-		DEBUG_TRACE("Found EOF.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match('!')) {
-		tok.type = TOK_BANG;
-		tok.value = value;
-		assert(tok.value == "!");
-		DEBUG_TRACE("Found bang.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match("++")) {
-		tok.type = TOK_INCREMENT;
-		tok.value = value;
-		assert(tok.value == "++");
-		DEBUG_TRACE("Found increment.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match("--")) {
-		tok.type = TOK_DECREMENT;
-		tok.value = value;
-		assert(tok.value == "--");
-		DEBUG_TRACE("Found decrement.");
-		return;
-	}
-
-	Restore(tmp);
-	if (MatchKeyword("if")) {
-		tok.type = TOK_IF;
-		tok.value = value;
-		assert(tok.value == "if");
-		DEBUG_TRACE("Found if.");
-		return;
-	}
-
-	Restore(tmp);
-	if (MatchKeyword("while")) {
-		tok.type = TOK_WHILE;
-		tok.value = value;
-		assert(tok.value == "while");
-		DEBUG_TRACE("Found while.");
-		return;
-	}
-
-	Restore(tmp);
-	if (MatchKeyword("function")) {
-		tok.type = TOK_FUNCTION;
-		tok.value = value;
-		assert(tok.value == "function");
-		DEBUG_TRACE("Found function.");
-		return;
-	}
-
-	Restore(tmp);
-	if (MatchKeyword("return")) {
-		tok.type = TOK_RETURN;
-		tok.value = value;
-		assert(tok.value == "return");
-		DEBUG_TRACE("Found return.");
-		return;
-	}
-
-	Restore(tmp);
-	if (MatchKeyword("break")) {
-		tok.type = TOK_BREAK;
-		tok.value = value;
-		assert(tok.value == "break");
-		DEBUG_TRACE("Found break.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match('+')) {
-		tok.type = TOK_PLUS;
-		tok.value = value;
-		assert(tok.value == "+");
-		DEBUG_TRACE("Found +.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match('-')) {
-		tok.type = TOK_MINUS;
-		tok.value = value;
-		assert(tok.value == "-");
-		DEBUG_TRACE("Found -.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match('=')) {
-		tok.type = TOK_ASSIGN;
-		tok.value = value;
-		assert(tok.value == "=");
-		DEBUG_TRACE("Found =.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match(';')) {
-		tok.type = TOK_TERMINATOR;
-		tok.value = value;
-		assert(tok.value == ";");
-		DEBUG_TRACE("Found ;.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match(',')) {
-		tok.type = TOK_COMMA;
-		tok.value = value;
-		assert(tok.value == ",");
-		DEBUG_TRACE("Found ,.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match('(')) {
-		tok.type = TOK_LPAREN;
-		tok.value = value;
-		assert(tok.value == "(");
-		DEBUG_TRACE("Found (.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match(')')) {
-		tok.type = TOK_RPAREN;
-		tok.value = value;
-		assert(tok.value == ")");
-		DEBUG_TRACE("Found ).");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match('{')) {
-		tok.type = TOK_LBRACE;
-		tok.value = value;
-		assert(tok.value == "{");
-		DEBUG_TRACE("Found {.");
-		return;
-	}
-
-	Restore(tmp);
-	if (Match('}')) {
-		tok.type = TOK_RBRACE;
-		tok.value = value;
-		assert(tok.value == "}");
-		DEBUG_TRACE("Found }.");
-		return;
+	} else {
+		char c = input[head++];
+		char next = (head < inputLength) ? input[head] : '\0';
+		switch (c) {
+			case '!': tok.type = TOK_BANG; break;
+			case '=': tok.type = TOK_ASSIGN; break;
+			case ';': tok.type = TOK_TERMINATOR; break;
+			case ',': tok.type = TOK_COMMA; break;
+			case '(': tok.type = TOK_LPAREN; break;
+			case ')': tok.type = TOK_RPAREN; break;
+			case '{': tok.type = TOK_LBRACE; break;
+			case '}': tok.type = TOK_RBRACE; break;
+			case '+':
+				tok.type = TOK_PLUS;
+				if (next == '+') {
+					tok.type = TOK_INCREMENT;
+					head++;
+				}
+				break;
+			case '-':
+				tok.type = TOK_MINUS;
+				if (next == '-') {
+					tok.type = TOK_DECREMENT;
+					head++;
+				}
+				break;
+			default: {
+				unsigned char cls = classes[(unsigned char)c];
+				if (cls & CHAR_DIGIT) {
+					while (head < inputLength && (classes[(unsigned char)input[head]] & CHAR_DIGIT))
+						head++;
+					tok.type = TOK_DECIMAL_INTEGER;
+				} else if (cls & CHAR_ALPHA) {
+					while (head < inputLength && (classes[(unsigned char)input[head]] & CHAR_IDENTIFIER))
+						head++;
+					tok.type = KeywordType(input + start, head - start);
+					if (tok.type == TOK_IDENTIFIER)
+						tok.atom = Intern(input + start, head - start);
+				} else {
+					tok.type = TOK_UNKNOWN;
+				}
+				break;
+			}
+		}
 	}
 
+	tok.offset = start;
+	tok.length = head - start;
+	tok.line = line;
+	tok.column = start - lineStart;
+}
 
-	Restore(tmp);
-	if (MatchDecimalInteger()) {
-		tok.type = TOK_DECIMAL_INTEGER;
-		tok.value = value;
-		assert(IsDigit(tok.value[0]));
-		DEBUG_TRACE("Found decimal integer.");
-		return;
-	}
-
-	Restore(tmp);
-	if (MatchIdentifier()) {
-		tok.type = TOK_IDENTIFIER;
-		tok.value = value;
-		assert(IsAlpha(tok.value[0]));
-		DEBUG_TRACE("Found identifier.");
-		return;
-	}
+// Lex from the start of the input to the end, EOF included
+void Lexer::Tokenize(vector<token_t>& out) {
+	Reset();
+	out.clear();
+	do {
+		AdvanceToken();
+		out.push_back(tok);
+	} while (tok.type != TOK_EOF);
 }
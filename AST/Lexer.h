@@ -2,6 +2,8 @@
 #define __LEXER_H__
 
 #include "Common.h"
+#include "Atom.h"
+#include "Source.h"
 
 enum tokenType_t {
 	TOK_IDENTIFIER,
@@ -25,51 +27,53 @@ enum tokenType_t {
 	TOK_RETURN,
 	TOK_EOF,
 	TOK_BANG,
+	TOK_UNKNOWN,
 	NUM_TOK
 };
 
+// Tokens refer to the source by offset and are plain values, so
+// saving and restoring the lexer never allocates
 struct token_t {
 	tokenType_t	type;
-	string		value;
+	int			offset;
+	int			length;
+	int			line;
+	int			column;
+	atom_t		atom;
+};
+
+struct lexerState_t {
+	int			head;
+	int			line;
+	int			lineStart;
+	token_t		tok;
 };
 
 class Lexer {
 private:
-	int			head;
-	char		look;
-	string		value;
+	SourceRef	source;
 	const char* input;
 	int			inputLength;
+	int			head;
 	int			line;
+	int			lineStart;
 	token_t		tok;
 private:
-	void		_ClearToken();
-	void		_Push(char c);
-	void		_Pop();
-	void		_Clear();
+	void		_SkipWhite();
 public:
-				Lexer(const char* input);
+				Lexer(const SourceRef& source);
 				~Lexer();
 
 	int			Line() const;
 	int			Head() const;
-	token_t		Token() const;
+	const token_t& Token() const;
+	const char*	Lexeme(const token_t& token) const;
+	string		Text(const token_t& token) const;
 	void		AdvanceToken();
-	void		Advance();
-	void		Restore(int where);
-	void		Restore(int where, token_t reset);
-
-	bool		MatchAlpha();
-	bool		MatchAlphaNum();
-	bool		MatchWhite();
-	bool		MatchVerticalWhite();
-	bool		MatchDecimalDigit();
-	bool		MatchDecimalInteger();
-	bool		MatchIdentifier();
-	bool		Match(const char* str);
-	bool		MatchKeyword(const char* str);
-	bool		Match(char c);
-	bool		MatchLineComment();
+	void		Tokenize(vector<token_t>& out);
+	void		Reset();
+	lexerState_t State() const;
+	void		Restore(const lexerState_t& state);
 };
 
 #endif // __LEXER_H__
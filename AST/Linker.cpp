@@ -0,0 +1,103 @@
+#include "Linker.h"
+#include "Resolver.h"
+#include <atomic>
+#include <thread>
+
+Linker::Linker() {
+	jobs = 0;
+}
+
+Linker::~Linker() {
+}
+
+void Linker::SetJobs(size_t n) {
+	jobs = n;
+}
+
+size_t Linker::Jobs() const {
+	if (jobs > 0)
+		return jobs;
+	size_t n = thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+bool Linker::HasError() const {
+	return !errors.empty();
+}
+
+const vector<linkError_t>& Linker::Errors() const {
+	return errors;
+}
+
+linkResult_t Linker::Link(const vector<string>& fileNames) {
+	return _Link(fileNames, vector<SourceRef>(fileNames.size()));
+}
+
+linkResult_t Linker::Link(const vector<SourceRef>& sources) {
+	vector<string> names;
+	for (size_t i = 0; i < sources.size(); ++i)
+		names.push_back("<source " + to_string(i) + ">");
+	return _Link(names, sources);
+}
+
+// Sources that are null are read from the named file
+linkResult_t Linker::_Link(const vector<string>& names, const vector<SourceRef>& sources) {
+	assert(names.size() == sources.size());
+	size_t count = names.size();
+	vector<SourceRef> read(sources);
+	vector<parseResult_t> parsed(count);
+	// Files without a tree failed, with the error next to it
+	vector<parseError_t> failed(count);
+
+	// Workers take the next file until none are left
+	atomic<size_t> next(0);
+	auto work = [&]() {
+		for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+			if (read[i] == nullptr)
+				read[i] = ReadSource(names[i]);
+			if (read[i] == nullptr) {
+				failed[i].code = PARSE_ERR_NONE;
+				failed[i].details = "cannot read file";
+				failed[i].line = 0;
+				failed[i].column = 0;
+				continue;
+			}
+			Parser parser(read[i]);
+			parser.Resolve(false);
+			parsed[i] = parser.Parse();
+			failed[i] = parser.Error();
+		}
+	};
+
+	size_t numThreads = Jobs() < count ? Jobs() : count;
+	vector<thread> threads;
+	for (size_t i = 1; i < numThreads; ++i)
+		threads.push_back(thread(work));
+	work();
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+
+	linkResult_t result;
+	errors.clear();
+	for (size_t i = 0; i < count; ++i) {
+		if (parsed[i].ast != nullptr)
+			continue;
+		linkError_t e;
+		e.file = names[i];
+		e.error = failed[i];
+		errors.push_back(e);
+	}
+	if (HasError())
+		return result;
+
+	result.sources = read;
+	// The passes that rewrite the program allocate from its arena, and
+	// the parsed statements all live in arenas
+	result.ast = new ASTProgram(new Arena());
+	for (size_t i = 0; i < count; ++i)
+		result.ast->Append(parsed[i].ast.get());
+
+	Resolver resolver;
+	result.global = resolver.Resolve(result.ast.get());
+	return result;
+}
@@ -0,0 +1,44 @@
+#ifndef __LINKER_H__
+#define __LINKER_H__
+
+#include "Common.h"
+#include "Parser.h"
+
+struct linkError_t {
+	string					file;
+	// Code PARSE_ERR_NONE when the file could not be read
+	parseError_t			error;
+};
+
+struct linkResult_t {
+	vector<SourceRef>		sources;
+	Ref<Scope>				global;
+	Ref<ASTProgram>			ast;
+};
+
+// Parses many scripts at once and links them into one resolved program,
+// in the order they are given, as if they were a single script. Names
+// are interned in the shared atom table and functions of every file can
+// call each other.
+class Linker {
+private:
+	size_t					jobs;
+	vector<linkError_t>		errors;
+private:
+	linkResult_t			_Link(const vector<string>& names, const vector<SourceRef>& sources);
+public:
+							Linker();
+							~Linker();
+
+	// Files parsed at the same time, 0 for one per hardware thread
+	void					SetJobs(size_t n);
+	size_t					Jobs() const;
+
+	bool					HasError() const;
+	const vector<linkError_t>& Errors() const;
+
+	linkResult_t			Link(const vector<string>& fileNames);
+	linkResult_t			Link(const vector<SourceRef>& sources);
+};
+
+#endif // __LINKER_H__
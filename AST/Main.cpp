@@ -3,7 +3,14 @@
 #include "Dict.h"
 #include "Symbol.h"
 #include "Engine.h"
-
+#include "Optimizer.h"
+#include "Fuser.h"
+#include "Flattener.h"
+#include "Linker.h"
+#include "BytecodeCache.h"
+#include "Bench.h"
+
+#include <cstring>
 #include <Windows.h>
 
 class ASTPostOrderPrinter {
@@ -51,6 +58,12 @@ public:
 				Print((ASTReturn*)node); break;
 			case AST_NOT:
 				Print((ASTNot*)node); break;
+			case AST_ADD_ASSIGN_CONST:
+				Print((ASTAddAssignConst*)node); break;
+			case AST_WHILE_VAR_NON_ZERO:
+				Print((ASTWhileVarNonZero*)node); break;
+			case AST_NOT_SUB_CONST:
+				Print((ASTNotSubConst*)node); break;
 			default:
 				assert(false); break;
 		}
@@ -63,7 +76,7 @@ public:
 
 	void Print(ASTReturn* node) {
 		indentation++;
-		Print(node->Expression().get());
+		Print(node->Expression());
 		indentation--;
 		PrintIndent();
 		printf("Return\n");
@@ -76,8 +89,8 @@ public:
 
 	void Print(ASTProgram* node) {
 		indentation++;
-		for (size_t i = 0; i < node->NumChildren(); ++i) {
-			Print(node->Child(i).get());
+		for (ASTNode* child : node->Children()) {
+			Print(child);
 		}
 		printf("Program\n");
 		indentation--;
@@ -95,38 +108,38 @@ public:
 
 	void Print(ASTIncrement* node) {
 		indentation++;
-		Print(node->Child(0).get());
+		Print(node->Child(0));
 		indentation--;
 		PrintIndent(); printf("Increment (++)\n");
 	}
 
 	void Print(ASTDecrement* node) {
 		indentation++;
-		Print(node->Child(0).get());
+		Print(node->Child(0));
 		indentation--;
 		PrintIndent(); printf("Decrement (--)\n");
 	}
 
 	void Print(ASTIf* node) {
 		indentation++;
-		Print(node->Expression().get());
-		Print(node->Statement().get());
+		Print(node->Expression());
+		Print(node->Statement());
 		indentation--;
 		PrintIndent(); printf("If\n");
 	}
 
 	void Print(ASTWhile* node) {
 		indentation++;
-		Print(node->Expression().get());
-		Print(node->Statement().get());
+		Print(node->Expression());
+		Print(node->Statement());
 		indentation--;
 		PrintIndent(); printf("While\n");
 	}
 
 	void Print(ASTBlock* node) {
 		indentation++;
-		for (size_t i = 0; i < node->NumChildren(); ++i) {
-			Print(node->Child(i).get());
+		for (ASTNode* child : node->Children()) {
+			Print(child);
 		}
 		indentation--;
 		PrintIndent(); printf("Block\n");
@@ -134,16 +147,16 @@ public:
 
 	void Print(ASTAssign* node) {
 		indentation++;
-		Print(node->Child(0).get());
-		Print(node->Child(1).get());
+		Print(node->Child(0));
+		Print(node->Child(1));
 		indentation--;
 		PrintIndent();  printf("=\n");
 	}
 
 	void Print(ASTCall* node) {
 		indentation++;
-		for (size_t i = 0; i < node->NumChildren(); ++i) {
-			Print(node->Child(i).get());
+		for (ASTNode* child : node->Children()) {
+			Print(child);
 		}
 		indentation--;
 		PrintIndent(); printf("Call\n");
@@ -151,65 +164,157 @@ public:
 
 	void Print(ASTFuncDef* node) {
 		indentation++;
-		for (size_t i = 0; i < node->NumChildren(); ++i) {
-			Print(node->Child(i).get());
+		for (ASTNode* child : node->Children()) {
+			Print(child);
 		}
 		indentation--;
 		PrintIndent(); printf("Function %s\n", node->Name().c_str());
 	}
 
 	void Print(ASTAdd* add) {
+		PrintChain(add);
+	}
+
+	void Print(ASTSubtract* sub) {
+		PrintChain(sub);
+	}
+
+	// Chains are deep on the left, so their left side is walked rather
+	// than recursed into. Each operator still prints one level deeper
+	// than the one above it, as if it had been recursed into.
+	void PrintChain(ASTNode* node) {
+		vector<ASTNode*> chain;
+		ASTNode* term = node;
+		while (term->Type() == AST_ADD || term->Type() == AST_SUBTRACT) {
+			chain.push_back(term);
+			term = term->Child(0);
+		}
+
+		int base = indentation;
+		indentation = base + (int)chain.size();
+		Print(term);
+		for (size_t i = chain.size(); i > 0; --i) {
+			ASTNode* op = chain[i - 1];
+			indentation = base + (int)i;
+			Print(op->Child(1));
+			indentation = base + (int)i - 1;
+			PrintIndent(); printf(op->Type() == AST_ADD ? "+\n" : "-\n");
+		}
+	}
+
+	void Print(ASTParameter* param) {
+		PrintIndent();
+		printf("Parameter %s\n", param->Name().c_str());
+	}
+
+	// The flat layout is in post-order already, so once the depth of each
+	// node is known it prints front to back. Variables show as slots.
+	void Print(const FlatProgram* program) {
+		size_t count = program->NumNodes();
+		vector<int> depth(count, 0);
+		for (size_t i = count; i > 0; --i) {
+			uint32_t node = static_cast<uint32_t>(i - 1);
+			for (size_t c = 0; c < program->NumChildren(node); ++c)
+				depth[program->Child(node, c)] = depth[node] + 1;
+		}
+
+		for (uint32_t node = 0; node < count; ++node) {
+			indentation = depth[node];
+			PrintIndent();
+			Print(program, node);
+		}
+		indentation = 0;
+	}
+
+	void Print(const FlatProgram* program, uint32_t node) {
+		int a = program->OperandA(node);
+		int c = program->OperandC(node);
+		switch (program->Type(node)) {
+			case AST_PROGRAM:
+				printf("Program\n"); break;
+			case AST_INT_LITERAL:
+				printf("Int Literal %d\n", a); break;
+			case AST_IDENTIFIER:
+				printf("Identifier [%d]\n", a); break;
+			case AST_ASSIGN:
+				printf("= [%d]\n", a); break;
+			case AST_BLOCK:
+				printf("Block\n"); break;
+			case AST_CALL:
+				printf("Call %s\n", AtomName(program->SiteName(program->OperandB(node))).c_str()); break;
+			case AST_FUNC_DEF:
+				if (a < 0)
+					printf("Function\n");
+				else
+					printf("Function %s\n", AtomName(program->Function(a).name).c_str());
+				break;
+			case AST_ADD:
+				printf("+\n"); break;
+			case AST_SUBTRACT:
+				printf("-\n"); break;
+			case AST_INCREMENT:
+				printf("Increment (++)\n"); break;
+			case AST_DECREMENT:
+				printf("Decrement (--)\n"); break;
+			case AST_NOT:
+				printf("Not\n"); break;
+			case AST_BREAK:
+				printf("Break\n"); break;
+			case AST_RETURN:
+				printf("Return\n"); break;
+			case AST_IF:
+				printf("If\n"); break;
+			case AST_WHILE:
+				printf("While\n"); break;
+			case AST_ADD_ASSIGN_CONST:
+				printf("[%d] += %d\n", a, c); break;
+			case AST_WHILE_VAR_NON_ZERO:
+				printf("While Variable [%d] (step %d)\n", a, c); break;
+			case AST_NOT_SUB_CONST:
+				printf("[%d] == %d\n", a, c); break;
+			default:
+				assert(false); break;
+		}
+	}
+
+	void Print(ASTAddAssignConst* node) {
 		indentation++;
-		Print(add->Child(0).get());
-		Print(add->Child(1).get());
+		Print(node->Identifier());
 		indentation--;
-		PrintIndent(); printf("+\n");
+		PrintIndent(); printf("+= %d\n", node->Constant());
 	}
 
-	void Print(ASTSubtract* add) {
+	void Print(ASTWhileVarNonZero* node) {
 		indentation++;
-		Print(add->Child(0).get());
-		Print(add->Child(1).get());
+		Print(node->Identifier());
+		Print(node->Statement());
 		indentation--;
-		PrintIndent(); printf("-\n");
+		PrintIndent(); printf("While Variable (step %d)\n", node->Step());
 	}
 
-	void Print(ASTParameter* param) {
-		PrintIndent();
-		printf("Parameter %s\n", param->Name().c_str());
+	void Print(ASTNotSubConst* node) {
+		indentation++;
+		Print(node->Identifier());
+		indentation--;
+		PrintIndent(); printf("== %d\n", node->Constant());
 	}
 };
 
-string GetFileText(const char* fileName) {
-	string buf;
-	FILE* p = nullptr;
-	fopen_s(&p, fileName, "rt");
-	if (p) {
-		fseek(p, 0, SEEK_END);
-		size_t size = ftell(p);
-		fseek(p, 0, SEEK_SET);
-		buf.resize(size);
-		fread(&buf[0], 1, size, p);
-		fclose(p);
-	}
-	return buf;
-}
-
-bool myPrint(const vector<object_t>& args, 
+bool myPrint(const argSpan_t& args, 
 	object_t* ret, callbackFailure_t* failure) {
 
 	printf("myPrint invoked ");
-	for (size_t i = 0; i < args.size(); ++i) {
+	for (size_t i = 0; i < args.size; ++i) {
 		printf("%d ", args[i].value._int);
 	}
 	printf("\n");
 	return true;
 }
 
-bool mySleep(const vector<object_t>& args,
+bool mySleep(const argSpan_t& args,
 	object_t* ret, callbackFailure_t* failure) {
 
-	if (args.size() < 1) {
+	if (args.size < 1) {
 		Sleep(1);
 		return true;
 	}
@@ -219,7 +324,7 @@ bool mySleep(const vector<object_t>& args,
 	return true;
 }
 
-int __cdecl main() {
+int __cdecl main(int argc, char** argv) {
 #ifdef _DEBUG
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
@@ -253,26 +358,123 @@ int __cdecl main() {
 	printf("%s\n",fs->Inner()->Resolve("Y")->Name().c_str());
 	printf("%s\n", fs->Inner()->Resolve("X")->Name().c_str());*/
 
-	string example = GetFileText("example.wire");
+	// Mapped, so a large script is neither copied nor held twice
+	SourceRef source = ReadSource("example.wire");
+	if (source == nullptr)
+		source = new Source("");
+
+	if (argc > 1 && strcmp(argv[1], "-bench") == 0) {
+		BenchLexer(string(source->Data(), source->Length()));
+		BenchParserNesting();
+		BenchTraversal();
+		BenchCalls();
+		BenchThreads();
+		BenchExecutor();
+		BenchLinker();
+		BenchCache();
+		BenchSource();
+		return 0;
+	}
+
+	// -flat prints and runs the flat layout of the program. Files named
+	// on the command line are linked and run instead of example.wire,
+	// --jobs n of them parsed at a time. Otherwise example.wire runs
+	// from example.wirec while that was compiled from the same text.
+	bool flat = false;
+	size_t jobs = 0;
+	vector<string> files;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-flat") == 0)
+			flat = true;
+		else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+			jobs = atoi(argv[++i]);
+		else
+			files.push_back(argv[i]);
+	}
+
+	Engine engine;
+	if (flat)
+		engine.SetExecutionMode(EXEC_FLAT);
+	engine.DefineCallback("println", 1, myPrint);
+	engine.DefineCallback("sleep", 1, mySleep);
+
+	const string cacheName = "example.wirec";
+	bool cached = files.empty() && !flat;
+	BytecodeCache cache;
+	ProgramRef program;
+	if (cached) {
+		BytecodeProgramRef code = cache.Load(cacheName, source.get());
+		if (code != nullptr)
+			program = engine.Load(code.get());
+		if (program != nullptr)
+			printf("Loaded %s\n", cacheName.c_str());
+		else if (code != nullptr)
+			printf("Compiling, callbacks changed\n");
+		else
+			printf("Compiling, %s\n", cache.Error().c_str());
+	}
 
-	Parser parser(example.c_str());
-	parseResult_t result = parser.Parse();
+	parseResult_t result;
+	bool failed = false;
+	if (program != nullptr) {
+		// Compiled already, nothing to parse
+	} else if (files.empty()) {
+		Parser parser(source);
+		result = parser.Parse();
+		if (parser.HasError()) {
+			parseError_t e = parser.Error();
+			printf("Syntax error: %d:%d %s\n", e.line + 1, e.column + 1, e.details.c_str());
+			failed = true;
+		}
+	} else {
+		Linker linker;
+		linker.SetJobs(jobs);
+		linkResult_t linked = linker.Link(files);
+		for (size_t i = 0; i < linker.Errors().size(); ++i) {
+			const linkError_t& e = linker.Errors()[i];
+			printf("Syntax error: %s:%d:%d %s\n", e.file.c_str(),
+				e.error.line + 1, e.error.column + 1, e.error.details.c_str());
+		}
+		result.ast = linked.ast;
+		result.global = linked.global;
+		failed = linker.HasError();
+	}
 
-	if (!result.ast) {
+	if (!program && !result.ast) {
 		printf("AST is nullptr\n");
 	}
 
-	if (parser.HasError()) {
-		parseError_t e = parser.Error();
-		printf("Syntax error: %d %s\n", e.line + 1, e.details.c_str());
-	} else {
+	if (!program && !failed) {
+		Optimizer optimizer;
+		size_t eliminated = optimizer.Optimize(result.ast.get());
+		printf("Optimizer eliminated %d nodes\n", (int)eliminated);
+
+		Fuser fuser;
+		fuseCounts_t fused = fuser.Fuse(result.ast.get());
+		printf("Fuser fused %d x = x + k, %d while (x), %d !(x - k)\n",
+			(int)fused.addAssignConst, (int)fused.whileVarNonZero, (int)fused.notSubConst);
+
 		ASTPostOrderPrinter printer;
-		printer.Print(result.ast.get());
+		if (flat) {
+			Flattener flattener;
+			FlatProgramRef layout = flattener.Flatten(result.ast.get());
+			printer.Print(layout.get());
+		} else {
+			printer.Print(result.ast.get());
+		}
 
-		Engine engine;
-		engine.DefineCallback("println", 1, myPrint);
-		engine.DefineCallback("sleep", 1, mySleep);
-		engine.Execute(result.ast.get());
+		program = engine.Load(result.ast.get());
+		if (cached && !cache.Save(cacheName, program->Code(), source.get()))
+			printf("%s\n", cache.Error().c_str());
+	}
+
+	if (program != nullptr) {
+		engine.Execute(program.get());
+
+		if (engine.HasError()) {
+			runtimeError_t e = engine.Error();
+			printf("Runtime error: %s\n", e.details.c_str());
+		}
 
 		//int result = engine.Execute(root.get());
 		//printf("Execution finished with result %d\n", result);
@@ -280,4 +482,4 @@ int __cdecl main() {
 
 	system("pause");
 	return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
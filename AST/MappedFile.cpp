@@ -0,0 +1,122 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+	data = nullptr;
+	length = 0;
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+	_Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const string& fileName) {
+	_Close();
+	file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		_Close();
+		return false;
+	}
+	if (size.QuadPart == 0)
+		return true;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		_Close();
+		return false;
+	}
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr) {
+		_Close();
+		return false;
+	}
+	length = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::_Close() {
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	data = nullptr;
+	length = 0;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::Open(const string& fileName) {
+	_Close();
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return false;
+	}
+	if (info.st_size == 0) {
+		close(fd);
+		return true;
+	}
+
+	// The mapping holds on to the file, the descriptor is not needed
+	void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	data = (const char*)view;
+	length = static_cast<size_t>(info.st_size);
+	return true;
+}
+
+void MappedFile::_Close() {
+	if (data != nullptr)
+		munmap((void*)data, length);
+	data = nullptr;
+	length = 0;
+}
+
+#endif
+
+const char* MappedFile::Data() const {
+	return data;
+}
+
+size_t MappedFile::Length() const {
+	return length;
+}
+
+FILE* OpenFile(const string& fileName, const char* mode) {
+#ifdef _WIN32
+	FILE* p = nullptr;
+	fopen_s(&p, fileName.c_str(), mode);
+	return p;
+#else
+	return fopen(fileName.c_str(), mode);
+#endif
+}
@@ -0,0 +1,38 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include "Common.h"
+#include "Ref.h"
+#include <cstdio>
+
+// A whole file mapped read only into memory. The view stays valid for
+// as long as the object lives.
+class MappedFile : public virtual RefObject {
+private:
+	const char*		data;
+	size_t			length;
+#ifdef _WIN32
+	void*			file;
+	void*			mapping;
+#endif
+private:
+	void			_Close();
+public:
+					MappedFile();
+					~MappedFile();
+
+	// False when the file cannot be opened or mapped. An empty file maps
+	// to a null view of length 0.
+	bool			Open(const string& fileName);
+
+	const char*		Data() const;
+	size_t			Length() const;
+};
+
+typedef Ref<MappedFile> MappedFileRef;
+
+// fopen, by way of fopen_s where the runtime asks for it. Null when the
+// file cannot be opened.
+FILE* OpenFile(const string& fileName, const char* mode);
+
+#endif // __MAPPED_FILE_H__
@@ -0,0 +1,167 @@
+#include "Optimizer.h"
+
+// Integer arithmetic wraps, as it does when executed
+static int WrapAdd(int a, int b) {
+	return static_cast<int>(static_cast<unsigned int>(a) + static_cast<unsigned int>(b));
+}
+
+static int WrapSub(int a, int b) {
+	return static_cast<int>(static_cast<unsigned int>(a) - static_cast<unsigned int>(b));
+}
+
+Optimizer::Optimizer() {
+	arena = nullptr;
+}
+
+Optimizer::~Optimizer() {
+}
+
+// Additions and subtractions yield an integer or null. Adding zero to
+// anything else, such as a string returned by a callback, gives null,
+// so x + 0 is only x for these.
+bool Optimizer::_IsNumeric(ASTNode* node) {
+	return (
+		node->Type() == AST_INT_LITERAL ||
+		node->Type() == AST_ADD ||
+		node->Type() == AST_SUBTRACT
+		);
+}
+
+size_t Optimizer::_Count(ASTNode* node) {
+	size_t count = 0;
+	vector<ASTNode*> pending(1, node);
+	while (!pending.empty()) {
+		ASTNode* next = pending.back();
+		pending.pop_back();
+		count++;
+		for (size_t i = 0; i < next->NumChildren(); ++i)
+			pending.push_back(next->Child(i));
+	}
+	return count;
+}
+
+// condition is set when only the truth of the value matters, as in the
+// test of an if or while and the operand of a not
+ASTNodeRef Optimizer::_Optimize(ASTNode* node, bool condition) {
+	if (node->Type() == AST_ADD || node->Type() == AST_SUBTRACT)
+		return _OptimizeAdditive(node);
+
+	for (size_t i = 0; i < node->NumChildren(); ++i) {
+		bool test = (node->Type() == AST_NOT) ||
+			((node->Type() == AST_IF || node->Type() == AST_WHILE) && i == 0);
+
+		ASTNodeRef child = node->Child(i);
+		ASTNodeRef result = _Optimize(child.get(), test);
+		if (result != child.get())
+			node->ReplaceChild(i, result);
+	}
+
+	if (node->Type() == AST_NOT)
+		return _Fold((ASTNot*)node, condition);
+	return node;
+}
+
+// Same order as the walk above, left operand, right operand, fold, but
+// a chain deep on the left is walked back up rather than recursed into
+ASTNodeRef Optimizer::_OptimizeAdditive(ASTNode* node) {
+	vector<ASTNode*> chain;
+	ASTNode* term = node;
+	while (term->Type() == AST_ADD || term->Type() == AST_SUBTRACT) {
+		chain.push_back(term);
+		term = term->Child(0);
+	}
+
+	ASTNodeRef result = _Optimize(term, false);
+	for (size_t i = chain.size(); i > 0; --i) {
+		ASTNode* op = chain[i - 1];
+		if (result != op->Child(0))
+			op->ReplaceChild(0, result);
+
+		ASTNodeRef rhs = op->Child(1);
+		ASTNodeRef folded = _Optimize(rhs.get(), false);
+		if (folded != rhs.get())
+			op->ReplaceChild(1, folded);
+
+		result = _Fold(op);
+	}
+	return result;
+}
+
+ASTNodeRef Optimizer::_Fold(ASTNode* node) {
+	bool add = node->Type() == AST_ADD;
+	ASTNodeRef a = node->Child(0);
+	ASTNodeRef b = node->Child(1);
+
+	if (a->Type() == AST_INT_LITERAL && b->Type() == AST_INT_LITERAL) {
+		ASTIntLiteral* x = (ASTIntLiteral*)a.get();
+		ASTIntLiteral* y = (ASTIntLiteral*)b.get();
+		x->SetValue(add ? WrapAdd(x->Value(), y->Value()) : WrapSub(x->Value(), y->Value()));
+		return a;
+	}
+
+	// Bring the literal to the right, 1 + x is x + 1
+	bool changed = false;
+	if (add && a->Type() == AST_INT_LITERAL) {
+		swap(a, b);
+		changed = true;
+	}
+
+	if (b->Type() != AST_INT_LITERAL)
+		return node;
+
+	// Reduce to e + k
+	ASTIntLiteral* literal = (ASTIntLiteral*)b.get();
+	ASTNodeRef e = a;
+	int k = add ? literal->Value() : WrapSub(0, literal->Value());
+
+	// Children are already folded, so a literal chain is one level deep
+	if ((e->Type() == AST_ADD || e->Type() == AST_SUBTRACT) &&
+		e->Child(1)->Type() == AST_INT_LITERAL) {
+		int inner = ((ASTIntLiteral*)e->Child(1))->Value();
+		k = (e->Type() == AST_ADD) ? WrapAdd(k, inner) : WrapSub(k, inner);
+		e = e->Child(0);
+		changed = true;
+	}
+
+	if (k == 0 && _IsNumeric(e.get()))
+		return e;
+
+	if (!changed)
+		return node;
+
+	literal->SetValue(k);
+	return ASTNew<ASTAdd>(arena, e, b);
+}
+
+ASTNodeRef Optimizer::_Fold(ASTNot* node, bool condition) {
+	ASTNodeRef e = node->Expression();
+
+	if (e->Type() == AST_INT_LITERAL) {
+		ASTIntLiteral* literal = (ASTIntLiteral*)e.get();
+		literal->SetValue(!literal->Value());
+		return e;
+	}
+
+	// !!x is 0 or 1 rather than x, which only matters when more than its
+	// truth is used, unless x is itself 0 or 1
+	if (e->Type() == AST_NOT) {
+		ASTNodeRef inner = ((ASTNot*)e.get())->Expression();
+		if (condition || inner->Type() == AST_NOT)
+			return inner;
+	}
+
+	return node;
+}
+
+size_t Optimizer::Optimize(ASTProgram* program) {
+	assert(program != nullptr);
+	arena = program->Memory();
+
+	size_t before = _Count(program);
+	_Optimize(program, false);
+	size_t after = _Count(program);
+
+	arena = nullptr;
+	assert(after <= before);
+	return before - after;
+}
@@ -0,0 +1,29 @@
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include "Common.h"
+#include "AST.h"
+
+// Rewrites a parsed program before it is executed. Folds additions,
+// subtractions and negations of literals, merges literal chains such as
+// x + 1 + 2 and drops x + 0, x - 0 and !!x where that cannot change the
+// result.
+class Optimizer {
+private:
+	Arena*					arena;
+private:
+	ASTNodeRef				_Optimize(ASTNode* node, bool condition);
+	ASTNodeRef				_OptimizeAdditive(ASTNode* node);
+	ASTNodeRef				_Fold(ASTNode* node);
+	ASTNodeRef				_Fold(ASTNot* node, bool condition);
+	static bool				_IsNumeric(ASTNode* node);
+	static size_t			_Count(ASTNode* node);
+public:
+							Optimizer();
+							~Optimizer();
+
+	// Rewrite in place, returns the number of nodes eliminated
+	size_t					Optimize(ASTProgram* program);
+};
+
+#endif // __OPTIMIZER_H__
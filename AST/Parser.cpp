@@ -1,14 +1,42 @@
 #include "Parser.h"
+#include "Resolver.h"
 
-Parser::Parser(const char * input) : lexer(input) {
+Parser::Parser(const char * input) : Parser(SourceRef(new Source(input))) {
+}
+
+Parser::Parser(const SourceRef& source) : lexer(source) {
 	error.code = PARSE_ERR_NONE;
 	error.details = "";
-	speculative = 0;
+	error.line = 0;
+	error.column = 0;
+	result.source = source;
+	preTokenize = true;
+	resolve = true;
+	position = 0;
+	depth = 0;
+	maxDepth = DEFAULT_MAX_PARSE_DEPTH;
+	builder.UseArena(true);
 }
 
 Parser::~Parser() {
 }
 
+void Parser::UseArena(bool val) {
+	builder.UseArena(val);
+}
+
+void Parser::PreTokenize(bool val) {
+	preTokenize = val;
+}
+
+void Parser::Resolve(bool val) {
+	resolve = val;
+}
+
+void Parser::SetMaxDepth(size_t depth) {
+	maxDepth = depth;
+}
+
 bool Parser::HasError() const {
 	return (error.code != PARSE_ERR_NONE);
 }
@@ -17,37 +45,51 @@ parseError_t Parser::Error() const {
 	return error;
 }
 
-void Parser::Save() {
-	lexerState_t state;
-	state.head = lexer.Head();
-	state.tok = lexer.Token();
-	saved.push_back(state);
+const token_t& Parser::Current() const {
+	return preTokenize ? tokens[position] : lexer.Token();
 }
 
-void Parser::Backtrack() {
-	lexerState_t& state = saved.back();
-	lexer.Restore(state.head, state.tok);
-	saved.pop_back();
+void Parser::Next() {
+	if (preTokenize) {
+		// The last token is EOF, stay on it
+		if (position + 1 < tokens.size())
+			position++;
+	} else {
+		lexer.AdvanceToken();
+	}
 }
 
-void Parser::Speculate(bool val) {
-	if (val) speculative++;
-	else speculative--;
-	builder.Speculate(speculative != 0 ? true : false);
+// Type of the token after the current one
+tokenType_t Parser::Peek() {
+	if (preTokenize)
+		return tokens[position + 1 < tokens.size() ? position + 1 : position].type;
+
+	lexerState_t state = lexer.State();
+	lexer.AdvanceToken();
+	tokenType_t type = lexer.Token().type;
+	lexer.Restore(state);
+	return type;
 }
 
 bool Parser::Match(tokenType_t type) {
-	if (lexer.Token().type == type) {
-		matched = lexer.Token();
-		lexer.AdvanceToken();
+	const token_t& tok = Current();
+	if (tok.type == type) {
+		matched = tok;
+		Next();
 		return true;
 	}
 	return false;
 }
 
 parseResult_t Parser::Parse() {
-	lexer.Restore(0);
-	lexer.AdvanceToken();
+	lexer.Reset();
+	depth = 0;
+	if (preTokenize) {
+		lexer.Tokenize(tokens);
+		position = 0;
+	} else {
+		lexer.AdvanceToken();
+	}
 
 	_ExpProgram();
 
@@ -56,6 +98,10 @@ parseResult_t Parser::Parse() {
 		result.global = nullptr;
 	} else {
 		result.ast = builder.AST();
+		if (resolve) {
+			Resolver resolver;
+			result.global = resolver.Resolve(result.ast.get());
+		}
 	}
 
 	return result;
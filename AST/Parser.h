@@ -19,20 +19,23 @@ enum parseErrorCode_t {
 	PARSE_ERR_EXPECTING_EXPRESSION,
 	PARSE_ERR_EXPECTING_BLOCK,
 	PARSE_ERR_EXPECTING_BLOCK_END,
+	PARSE_ERR_TOO_DEEP,
 };
 
+// Statements and expressions nest this deep unless the host sets another
+// limit. Every level costs native stack in the parser and in the passes
+// after it, nesting deeper is a syntax error.
+const size_t DEFAULT_MAX_PARSE_DEPTH = 1000;
+
 struct parseError_t {
 	parseErrorCode_t		code;
 	string					details;
 	int						line;
-};
-
-struct lexerState_t {
-	int						head;
-	token_t					tok;
+	int						column;
 };
 
 struct parseResult_t {
+	SourceRef				source;
 	Ref<Scope>				global;
 	Ref<ASTProgram>			ast;
 };
@@ -41,21 +44,26 @@ class Parser {
 private:
 	Lexer					lexer;
 	parseError_t			error;
-	int						speculative;
 	token_t					matched;
-	vector<lexerState_t>	saved;
+	bool					preTokenize;
+	bool					resolve;
+	vector<token_t>			tokens;
+	size_t					position;
+	size_t					depth;
+	size_t					maxDepth;
 	parseResult_t			result;
 private:
 	Parser_AST				builder;
 private:
+	const token_t&			Current() const;
+	void					Next();
+	tokenType_t				Peek();
 	bool					Match(tokenType_t token);
-	void					Save();
-	void					Backtrack();
-	void					Speculate(bool val);
 	void					Error(parseErrorCode_t code);
 	void					Error(parseErrorCode_t code, string details);
 	void					CertainError(parseErrorCode_t code);
 	void					CertainError(parseErrorCode_t code, string details);
+	bool					TooDeep();
 private:
 	void					_ExpProgram();
 	bool					_ExpStatement();
@@ -79,8 +87,24 @@ private:
 	bool					_OptUnaryExpression();
 public:
 							Parser(const char* input);
+							Parser(const SourceRef& source);
 							~Parser();
 
+	// Build the AST in an arena owned by the program (the default),
+	// or allocate every node separately
+	void					UseArena(bool val);
+
+	// Lex the whole input before parsing (the default) so backtracking
+	// is an index reset, or lex on demand and restore the lexer instead
+	void					PreTokenize(bool val);
+
+	// Resolve the program once parsed (the default). Programs that are
+	// appended to others are resolved as a whole afterwards.
+	void					Resolve(bool val);
+
+	// Deepest nesting of statements and expressions that parses
+	void					SetMaxDepth(size_t depth);
+
 	bool					HasError() const;
 	parseError_t			Error() const;
 	parseResult_t			Parse();
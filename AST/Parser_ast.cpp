@@ -31,41 +31,34 @@ Ref<ASTProgram> Parser_AST::AST() {
 	return program;
 }
 
-void Parser_AST::Speculate(bool val) {
-	speculative = val;
+void Parser_AST::UseArena(bool val) {
+	arena = val ? new Arena() : nullptr;
 }
 
-void Parser_AST::MakePrimaryFromIdentifier(const string& value) {
-	if (speculative)
-		return;
-	DEBUG_TRACE_FMT("MakePrimaryFromIdentifier (%s)",value.c_str());
-	primary = new ASTIdentifier(value);
+void Parser_AST::MakePrimaryFromIdentifier(atom_t name) {
+	DEBUG_TRACE_FMT("MakePrimaryFromIdentifier (%s)",AtomName(name).c_str());
+	primary = _New<ASTIdentifier>(name);
 }
 
-void Parser_AST::MakePrimaryFromDecIntLiteral(const string& value) {
-	if (speculative)
-		return;
-	DEBUG_TRACE_FMT("MakePrimaryFromIntLiteral (%s)",value.c_str());
-	primary = new ASTIntLiteral(value);
+void Parser_AST::MakePrimaryFromDecIntLiteral(const char* text, int length) {
+	DEBUG_TRACE_FMT("MakePrimaryFromIntLiteral (%s)",string(text, length).c_str());
+	unsigned int value = 0;
+	for (int i = 0; i < length; ++i)
+		value = value * 10 + (text[i] - '0');
+	primary = _New<ASTIntLiteral>(static_cast<int>(value));
 }
 
 void Parser_AST::MakePrimaryFromExpression() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakePrimaryFromExpression");
 	primary = expression;
 }
 
-void Parser_AST::PushCallIdentifier(const string& value) {
-	if (speculative)
-		return;
-	DEBUG_TRACE_FMT("CallIdentifier (%s)",value.c_str());
-	callIdentifierStack.push_back(new ASTIdentifier(value));
+void Parser_AST::PushCallIdentifier(atom_t name) {
+	DEBUG_TRACE_FMT("CallIdentifier (%s)",AtomName(name).c_str());
+	callIdentifierStack.push_back(_New<ASTIdentifier>(name));
 }
 
 void Parser_AST::PushCallArgumentFromAssign() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("CallArgumentFromAssign");
 	assert(assign != nullptr);
 	callArgumentStack.push_back(assign);
@@ -73,22 +66,16 @@ void Parser_AST::PushCallArgumentFromAssign() {
 }
 
 void Parser_AST::PushCallArgumentBoundary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushCallArgumentBoundary");
 	callArgumentBoundaries.push_back(callArgumentStack.size());
 }
 
 void Parser_AST::PopCallArgumentBoundary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PopCallArgumentBoundary");
 	callArgumentBoundaries.pop_back();
 }
 
 void Parser_AST::MakeCall() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeCall");
 
 	size_t numArgs = callArgumentStack.size() - callArgumentBoundaries.back();
@@ -97,42 +84,36 @@ void Parser_AST::MakeCall() {
 	ASTIdentifierRef identifier = callIdentifierStack.back();
 	callIdentifierStack.pop_back();
 
-	call = new ASTCall(identifier);
+	call = _New<ASTCall>(identifier);
+	call->Reserve(1 + numArgs);
 	for (size_t i = 0; i < numArgs; ++i) {
 		call->AttachChild(callArgumentStack.back());
 		callArgumentStack.pop_back();
 	}
 }
 
-void Parser_AST::FunctionIdentifier(const string & value) {
-	if (speculative)
-		return;
+void Parser_AST::FunctionIdentifier(atom_t name) {
 	DEBUG_TRACE("FunctionIdentifier");
 	assert(functionIdentifier == nullptr);
-	functionIdentifier = new ASTIdentifier(value);
+	functionIdentifier = _New<ASTIdentifier>(name);
 }
 
-void Parser_AST::PushFunctionParameter(const string & value) {
-	if (speculative)
-		return;
+void Parser_AST::PushFunctionParameter(atom_t name) {
 	DEBUG_TRACE("FunctionParameter");
-	functionParameters.push_back(new ASTParameter(value));
+	functionParameters.push_back(_New<ASTParameter>(name));
 }
 
 void Parser_AST::FunctionBlockFromBlock() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("FunctionBlockFromBlock");
 	functionBlock = block;
 	block = nullptr;
 }
 
 void Parser_AST::MakeFunction() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeFunction");
 
-	function = new ASTFuncDef(functionIdentifier->Name(), functionBlock);
+	function = _New<ASTFuncDef>(functionIdentifier->Atom(), functionBlock);
+	function->Reserve(1 + functionParameters.size());
 	for (size_t i = 0; i < functionParameters.size(); ++i) {
 		function->AttachParameter(functionParameters[i]);
 	}
@@ -142,8 +123,6 @@ void Parser_AST::MakeFunction() {
 }
 
 void Parser_AST::MakeLhsFromPrimary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeLhsFromPrimary");
 	assert(primary != nullptr);
 	lhs = primary;
@@ -151,8 +130,6 @@ void Parser_AST::MakeLhsFromPrimary() {
 }
 
 void Parser_AST::MakeLhsFromCall() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeLhsFromCall");
 	assert(call != nullptr);
 	lhs = call;
@@ -160,8 +137,6 @@ void Parser_AST::MakeLhsFromCall() {
 }
 
 void Parser_AST::MakePostfixFromLhs() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakePostfixFromLhs");
 	assert(lhs != nullptr);
 	postfix = lhs;
@@ -169,26 +144,20 @@ void Parser_AST::MakePostfixFromLhs() {
 }
 
 void Parser_AST::MakePostfixDecrementFromLhs() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakePostfixIncrementFromLhs");
 	assert(lhs != nullptr);
-	postfix = new ASTDecrement(lhs);
+	postfix = _New<ASTDecrement>(lhs);
 	lhs = nullptr;
 }
 
 void Parser_AST::MakePostfixIncrementFromLhs() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakePostfixIncrementFromLhs");
 	assert(lhs != nullptr);
-	postfix = new ASTIncrement(lhs);
+	postfix = _New<ASTIncrement>(lhs);
 	lhs = nullptr;
 }
 
 void Parser_AST::PushAddTermFromUnary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushAddTermFromUnary");
 	assert(unary != nullptr);
 	addTermStack.push_back(unary);
@@ -196,29 +165,21 @@ void Parser_AST::PushAddTermFromUnary() {
 }
 
 void Parser_AST::PushAddTermBoundary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushAddTermBoundary");
 	addTermBoundaries.push_back(addTermStack.size());
 }
 
 void Parser_AST::PopAddTermBoundary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PopAddTermBoundary");
 	addTermBoundaries.pop_back();
 }
 
 void Parser_AST::PushAddTokenType(const tokenType_t& token) {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushAddToken");
 	addTokenStack.push_back(token);
 }
 
 void Parser_AST::MakeAdd() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeAdd");
 
 	size_t boundary = addTermBoundaries.back();
@@ -231,10 +192,10 @@ void Parser_AST::MakeAdd() {
 		add = addTermStack.back(); addTermStack.pop_back();
 	} else if (numTerms >= 2) {
 
-		auto NewAdd = [](ASTNodeRef a, ASTNodeRef b, tokenType_t type) -> ASTNodeRef {
+		auto NewAdd = [this](ASTNodeRef a, ASTNodeRef b, tokenType_t type) -> ASTNodeRef {
 			assert(type == TOK_PLUS || type == TOK_MINUS);
-			if (type == TOK_PLUS) return new ASTAdd(a, b);
-			if (type == TOK_MINUS) return new ASTSubtract(a, b);
+			if (type == TOK_PLUS) return _New<ASTAdd>(a, b);
+			if (type == TOK_MINUS) return _New<ASTSubtract>(a, b);
 			assert(false);
 			return nullptr;
 		};
@@ -257,8 +218,6 @@ void Parser_AST::MakeAdd() {
 }
 
 void Parser_AST::PushAssignLhsFromAdd() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushAssignLhsFromAdd");
 	assert(add != nullptr);
 	assignLhsStack.push_back(add);
@@ -266,8 +225,6 @@ void Parser_AST::PushAssignLhsFromAdd() {
 }
 
 void Parser_AST::PushAssignLhsFromLhs() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushAssignLhsFromLhs");
 	assert(lhs != nullptr);
 	assignLhsStack.push_back(lhs);
@@ -275,22 +232,16 @@ void Parser_AST::PushAssignLhsFromLhs() {
 }
 
 void Parser_AST::PushAssignLhsBoundary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushAssignLhsBoundary");
 	assignLhsBoundaries.push_back(assignLhsStack.size());
 }
 
 void Parser_AST::PopAssignLhsBoundary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PopAssignLhsBoundary");
 	assignLhsBoundaries.pop_back();
 }
 
 void Parser_AST::MakeAssign() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeAssign");
 
 	size_t numAssigns = assignLhsStack.size() - assignLhsBoundaries.back();
@@ -302,18 +253,16 @@ void Parser_AST::MakeAssign() {
 	} else if (numAssigns >= 2) {
 		ASTNodeRef b = assignLhsStack.back(); assignLhsStack.pop_back();
 		ASTNodeRef a = assignLhsStack.back(); assignLhsStack.pop_back();
-		ASTAssignRef assignNode = new ASTAssign(a, b);
+		ASTAssignRef assignNode = _New<ASTAssign>(a, b);
 		for (size_t i = 0; i < numAssigns - 2; ++i) {
 			ASTNodeRef x = assignLhsStack.back(); assignLhsStack.pop_back();
-			assignNode = new ASTAssign(x, assignNode);
+			assignNode = _New<ASTAssign>(x, assignNode);
 		}
 		assign = assignNode;
 	}
 }
 
 void Parser_AST::MakeExpressionFromAssign() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeExpressionFromAssign");
 	assert(assign != nullptr);
 	expression = assign;
@@ -321,15 +270,11 @@ void Parser_AST::MakeExpressionFromAssign() {
 }
 
 void Parser_AST::MakeExpression() {
-	if (speculative)
-		return;
 	// Forward
 	MakeExpressionFromAssign();
 }
 
 void Parser_AST::ReturnExpressionFromExpression() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("ReturnExpressionFromExpression");
 	assert(expression != nullptr);
 	ctrlReturnExpression = expression;
@@ -337,24 +282,18 @@ void Parser_AST::ReturnExpressionFromExpression() {
 }
 
 void Parser_AST::MakeReturn() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeReturn");
 	assert(ctrlReturnExpression != nullptr);
-	ctrlReturn = new ASTReturn(ctrlReturnExpression);
+	ctrlReturn = _New<ASTReturn>(ctrlReturnExpression);
 	ctrlReturnExpression = nullptr;
 }
 
 void Parser_AST::MakeBreak() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeBreak");
-	ctrlBreak = new ASTBreak();
+	ctrlBreak = _New<ASTBreak>();
 }
 
 void Parser_AST::MakeStatementFromBreak() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeStatementFromBreak");
 	assert(ctrlBreak != nullptr);
 	statement = ctrlBreak;
@@ -362,8 +301,6 @@ void Parser_AST::MakeStatementFromBreak() {
 }
 
 void Parser_AST::MakeStatementFromExpression() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeStatementFromExpression");
 	assert(expression != nullptr);
 	statement = expression;
@@ -371,8 +308,6 @@ void Parser_AST::MakeStatementFromExpression() {
 }
 
 void Parser_AST::MakeStatementFromFunction() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeStatementFromFunction");
 	assert(function != nullptr);
 	statement = function;
@@ -380,8 +315,6 @@ void Parser_AST::MakeStatementFromFunction() {
 }
 
 void Parser_AST::MakeStatementFromBlock() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeStatementFromBlock");
 	assert(block != nullptr);
 	statement = block;
@@ -390,8 +323,6 @@ void Parser_AST::MakeStatementFromBlock() {
 
 
 void Parser_AST::MakeStatementFromIf() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeStatementFromIf");
 	assert(ctrlIf != nullptr);
 	statement = ctrlIf;
@@ -399,8 +330,6 @@ void Parser_AST::MakeStatementFromIf() {
 }
 
 void Parser_AST::MakeStatementFromWhile() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeStatementFromWhile");
 	assert(ctrlWhile != nullptr);
 	statement = ctrlWhile;
@@ -408,8 +337,6 @@ void Parser_AST::MakeStatementFromWhile() {
 }
 
 void Parser_AST::MakeStatementFromReturn() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeStatementFromReturn");
 	assert(ctrlReturn != nullptr);
 	statement = ctrlReturn;
@@ -417,8 +344,6 @@ void Parser_AST::MakeStatementFromReturn() {
 }
 
 void Parser_AST::PushBlockStatementFromStatement() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("BlockStatementFromStatement");
 	assert(statement != nullptr);
 	blockStatements.push_back(statement);
@@ -426,22 +351,16 @@ void Parser_AST::PushBlockStatementFromStatement() {
 }
 
 void Parser_AST::PushBlockStatementBoundary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushBlockStatementBoundary");
 	blockBoundaries.push_back(blockStatements.size());
 }
 
 void Parser_AST::PopBlockStatementBoundary() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PopBlockStatementBoundary");
 	blockBoundaries.pop_back();
 }
 
 void Parser_AST::MakeBlock() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeBlock");
 
 	size_t boundary = blockBoundaries.back();
@@ -449,7 +368,8 @@ void Parser_AST::MakeBlock() {
 
 	size_t numStatements = blockStatements.size() - boundary;
 
-	block = new ASTBlock();
+	block = _New<ASTBlock>();
+	block->Reserve(numStatements);
 	for (size_t i = 0; i < numStatements; ++i) {
 		block->AttachChild(blockStatements[boundary + i]);
 	}
@@ -460,8 +380,6 @@ void Parser_AST::MakeBlock() {
 }
 
 void Parser_AST::ProgramStatementFromStatement() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("ProgramStatementFromStatement");
 	assert(statement != nullptr);
 	programStatements.push_back(statement);
@@ -469,10 +387,9 @@ void Parser_AST::ProgramStatementFromStatement() {
 }
 
 void Parser_AST::MakeProgram() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeProgram");
-	program = new ASTProgram();
+	program = new ASTProgram(arena.get());
+	program->Reserve(programStatements.size());
 	for (size_t i = 0; i < programStatements.size(); ++i) {
 		program->AttachChild(programStatements[i]);
 	}
@@ -484,8 +401,6 @@ void Parser_AST::MakeProgram() {
 }
 
 void Parser_AST::PushIfExpressionFromExpression() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushIfExpressionFromExpression");
 	assert(expression != nullptr);
 	ctrlIfExpressionStack.push_back(expression);
@@ -493,8 +408,6 @@ void Parser_AST::PushIfExpressionFromExpression() {
 }
 
 void Parser_AST::PushIfStatementFromStatement() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushIfStatementFromStatement");
 	assert(statement != nullptr);
 	ctrlIfStatementStack.push_back(statement);
@@ -502,8 +415,6 @@ void Parser_AST::PushIfStatementFromStatement() {
 }
 
 void Parser_AST::MakeIf() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeIf");
 
 	ASTNodeRef expr = ctrlIfExpressionStack.back();
@@ -512,12 +423,10 @@ void Parser_AST::MakeIf() {
 	ASTNodeRef stat = ctrlIfStatementStack.back();
 	ctrlIfStatementStack.pop_back();
 
-	ctrlIf = new ASTIf(expr, stat);
+	ctrlIf = _New<ASTIf>(expr, stat);
 }
 
 void Parser_AST::PushWhileExpressionFromExpression() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushWhileExpressionFromExpression");
 	assert(expression != nullptr);
 	ctrlWhileExpressionStack.push_back(expression);
@@ -525,8 +434,6 @@ void Parser_AST::PushWhileExpressionFromExpression() {
 }
 
 void Parser_AST::PushWhileStatementFromStatement() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("PushWhileStatementFromStatement");
 	assert(statement != nullptr);
 	ctrlWhileStatementStack.push_back(statement);
@@ -534,8 +441,6 @@ void Parser_AST::PushWhileStatementFromStatement() {
 }
 
 void Parser_AST::MakeWhile() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeWhile");
 
 	ASTNodeRef expr = ctrlWhileExpressionStack.back();
@@ -544,12 +449,10 @@ void Parser_AST::MakeWhile() {
 	ASTNodeRef stat = ctrlWhileStatementStack.back();
 	ctrlWhileStatementStack.pop_back();
 
-	ctrlWhile = new ASTWhile(expr, stat);
+	ctrlWhile = _New<ASTWhile>(expr, stat);
 }
 
 void Parser_AST::MakeUnaryFromPostfix() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeUnaryFromPostfix");
 	assert(postfix != nullptr);
 	unary = postfix;
@@ -557,10 +460,8 @@ void Parser_AST::MakeUnaryFromPostfix() {
 }
 
 void Parser_AST::MakeUnaryNotFromPostfix() {
-	if (speculative)
-		return;
 	DEBUG_TRACE("MakeUnaryNotFromPostfix");
 	assert(postfix != nullptr);
-	unary = new ASTNot(postfix);
+	unary = _New<ASTNot>(postfix);
 	postfix = nullptr;
 }
\ No newline at end of file
@@ -8,7 +8,8 @@
 class Parser_AST {
 private:
 	friend class Parser;
-	bool						speculative;
+	// Declared first so nodes held below are released before it
+	ArenaRef					arena;
 private:
 	// Primary
 	ASTNodeRef					primary;
@@ -68,24 +69,28 @@ private:
 	// Retrieve the AST
 	Ref<ASTProgram> AST();
 
-	// Turn on to disable operation
-	void Speculate(bool val);
+	// Allocate the nodes of this parse from a fresh arena, or from the heap
+	void UseArena(bool val);
+
+	template <typename T, typename... Args> T* _New(Args&&... args) {
+		return ASTNew<T>(arena.get(), std::forward<Args>(args)...);
+	}
 
 	// Primary
-	void MakePrimaryFromDecIntLiteral(const string& value);
-	void MakePrimaryFromIdentifier(const string& value);
+	void MakePrimaryFromDecIntLiteral(const char* text, int length);
+	void MakePrimaryFromIdentifier(atom_t name);
 	void MakePrimaryFromExpression();
 
 	// Call
-	void PushCallIdentifier(const string& value);
+	void PushCallIdentifier(atom_t name);
 	void PushCallArgumentFromAssign();
 	void PushCallArgumentBoundary();
 	void PopCallArgumentBoundary();
 	void MakeCall();
 
 	// Function
-	void FunctionIdentifier(const string& value);
-	void PushFunctionParameter(const string& value);
+	void FunctionIdentifier(atom_t name);
+	void PushFunctionParameter(atom_t name);
 	void FunctionBlockFromBlock();
 	void MakeFunction();
 
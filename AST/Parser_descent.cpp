@@ -1,14 +1,28 @@
 #include "Parser.h"
 
+// Counts a level of nesting for as long as it lives
+class NestingLevel {
+private:
+	size_t&		depth;
+public:
+	NestingLevel(size_t& depth) : depth(depth) {
+		depth++;
+	}
+
+	~NestingLevel() {
+		depth--;
+	}
+};
+
 bool Parser::_OptPrimary() {
 
 	if (Match(TOK_IDENTIFIER)) {
-		builder.MakePrimaryFromIdentifier(matched.value);
+		builder.MakePrimaryFromIdentifier(matched.atom);
 		return true;
 	}
 
 	if (Match(TOK_DECIMAL_INTEGER)) {
-		builder.MakePrimaryFromDecIntLiteral(matched.value);
+		builder.MakePrimaryFromDecIntLiteral(lexer.Lexeme(matched), matched.length);
 		return true;
 	}
 
@@ -40,26 +54,14 @@ bool Parser::_OptPrimary() {
 }
 
 bool Parser::_OptLhsExpression() {
-
-	auto Tentative = [&]() -> bool {
+	// identifier "(" starts a call, anything else is a primary
+	if (Current().type == TOK_IDENTIFIER && Peek() == TOK_LPAREN) {
 		if (!_OptCallExpression())
 			return false;
 		builder.MakeLhsFromCall();
 		return true;
-	};
-
-	Save();
-	Speculate(true);
-	if (Tentative()) {
-		Speculate(false);
-		Backtrack();
-		bool result = Tentative();
-		assert(result);
-		return true;
 	}
 
-	Speculate(false);
-	Backtrack();
 	if (_OptPrimary()) {
 		builder.MakeLhsFromPrimary();
 		return true;
@@ -96,7 +98,7 @@ bool Parser::_OptCallExpression() {
 	if (!Match(TOK_IDENTIFIER))
 		return false;
 
-	builder.PushCallIdentifier(matched.value);
+	builder.PushCallIdentifier(matched.atom);
 
 	if (!Match(TOK_LPAREN))
 		return false;
@@ -115,15 +117,20 @@ bool Parser::_OptCallExpression() {
 }
 
 bool Parser::_OptAssignExpression_r() {
+	NestingLevel level(depth);
+	if (TooDeep())
+		return false;
 
-	auto Tentative = [&]() -> bool {
+	// Only an identifier can be assigned to, so identifier "=" decides
+	// between an assignment and an additive expression
+	if (Current().type == TOK_IDENTIFIER && Peek() == TOK_ASSIGN) {
 		if (!_OptLhsExpression())
 			return false;
 
 		builder.PushAssignLhsFromLhs();
 
 		if (!Match(TOK_ASSIGN)) {
-			Error(PARSE_ERR_EXPECTING_ASSIGN);
+			CertainError(PARSE_ERR_EXPECTING_ASSIGN);
 			return false;
 		}
 
@@ -132,21 +139,9 @@ bool Parser::_OptAssignExpression_r() {
 			return false;
 		}
 
-		return true;
-	};
-
-	Save();
-	Speculate(true);
-	if (Tentative()) {
-		Speculate(false);
-		Backtrack();
-		bool result = Tentative();
-		assert(result);
 		return true;
 	}
 
-	Speculate(false);
-	Backtrack();
 	if (_OptAdd()) {
 		builder.PushAssignLhsFromAdd();
 		return true;
@@ -202,7 +197,7 @@ bool Parser::_OptFunctionStatement() {
 		return false;
 	}
 
-	builder.FunctionIdentifier(matched.value);
+	builder.FunctionIdentifier(matched.atom);
 
 	if (!Match(TOK_LPAREN)) {
 		CertainError(PARSE_ERR_EXPECTING_LEFT_PAREN);
@@ -326,7 +321,7 @@ void Parser::_OptParamList() {
 	if (!Match(TOK_IDENTIFIER))
 		return;
 
-	builder.PushFunctionParameter(matched.value);
+	builder.PushFunctionParameter(matched.atom);
 
 	while (Match(TOK_COMMA)) {
 		if (!Match(TOK_IDENTIFIER)) {
@@ -334,11 +329,15 @@ void Parser::_OptParamList() {
 			return;
 		}
 
-		builder.PushFunctionParameter(matched.value);
+		builder.PushFunctionParameter(matched.atom);
 	}
 }
 
 bool Parser::_OptStatement() {
+	NestingLevel level(depth);
+	if (TooDeep())
+		return false;
+
 	if (_OptBlock()) {
 		builder.MakeStatementFromBlock();
 		return true;
@@ -463,4 +462,4 @@ bool Parser::_OptPostfixExpression() {
 	}
 
 	return false;
-}
\ No newline at end of file
+}
\ No newline at end of file
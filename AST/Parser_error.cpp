@@ -33,6 +33,9 @@ static string ErrorMsg(parseErrorCode_t code) {
 		case PARSE_ERR_EXPECTING_BLOCK:
 			msg = "Expected a block";
 			break;
+		case PARSE_ERR_TOO_DEEP:
+			msg = "Nested too deeply";
+			break;
 		default:
 			msg = "Unknown error";
 			break;
@@ -41,31 +44,36 @@ static string ErrorMsg(parseErrorCode_t code) {
 }
 
 void Parser::Error(parseErrorCode_t code, string details) {
-	if (!speculative) {
-		if (error.code == PARSE_ERR_NONE) {
-			error.code = code;
-			error.details = details;
-			error.line = lexer.Line();
-		}
-	}
+	CertainError(code, details);
 }
 
 void Parser::Error(parseErrorCode_t code) {
-	string msg = ErrorMsg(code);
-	msg += ". Got: " + lexer.Token().value + ".";
-	Error(code, msg);
+	CertainError(code);
 }
 
 void Parser::CertainError(parseErrorCode_t code, string details) {
 	if (error.code == PARSE_ERR_NONE) {
+		token_t tok = Current();
 		error.code = code;
 		error.details = details;
-		error.line = lexer.Line();
+		error.line = tok.line;
+		error.column = tok.column;
 	}
 }
 
+// Statements and assignment expressions are where nesting recurses, each
+// of them is one level
+bool Parser::TooDeep() {
+	if (depth <= maxDepth)
+		return false;
+	CertainError(PARSE_ERR_TOO_DEEP);
+	return true;
+}
+
 void Parser::CertainError(parseErrorCode_t code) {
-	string msg = ErrorMsg(code);
-	msg += ". Got: " + lexer.Token().value + ".";
-	CertainError(code, msg);
+	if (error.code == PARSE_ERR_NONE) {
+		string msg = ErrorMsg(code);
+		msg += ". Got: " + lexer.Text(Current()) + ".";
+		CertainError(code, msg);
+	}
 }
@@ -1,10 +0,0 @@
-#include "Ref.h"
-
-void RefIncrement(RefObject* n) {
-	n->__count++;
-}
-
-bool RefDecrement(RefObject* n) {
-	n->__count--;
-	return (n->__count <= 0);
-}
\ No newline at end of file
@@ -1,15 +1,54 @@
 #ifndef __REF_H__
 #define __REF_H__
 
+#include <utility>
+
+// Intrusive reference counting. Counts are plain integers by default;
+// define REF_ATOMIC_COUNT for the whole build to make them atomic, so
+// that objects such as a parsed ASTProgram can be shared and released
+// by several threads.
+#ifdef REF_ATOMIC_COUNT
+#include <atomic>
+typedef std::atomic<int> refCount_t;
+#else
+typedef int refCount_t;
+#endif
+
 class RefObject {
 private:
 	friend void RefIncrement(RefObject*);
 	friend bool RefDecrement(RefObject*);
-	int __count = 0;
+	refCount_t __count;
+protected:
+	RefObject() : __count(0) {
+	}
+
+	// A copy is a new object with no references of its own
+	RefObject(const RefObject&) : __count(0) {
+	}
+
+	RefObject& operator = (const RefObject&) {
+		return (*this);
+	}
 };
 
-void RefIncrement(RefObject* n);
-bool RefDecrement(RefObject* n);
+inline void RefIncrement(RefObject* n) {
+#ifdef REF_ATOMIC_COUNT
+	n->__count.fetch_add(1, std::memory_order_relaxed);
+#else
+	n->__count++;
+#endif
+}
+
+// True when the last reference is gone
+inline bool RefDecrement(RefObject* n) {
+#ifdef REF_ATOMIC_COUNT
+	return n->__count.fetch_sub(1, std::memory_order_acq_rel) <= 1;
+#else
+	n->__count--;
+	return (n->__count <= 0);
+#endif
+}
 
 template <typename T> class Ref {
 private:
@@ -27,29 +66,31 @@ private:
 			RefIncrement(ptr);
 	}
 	void _assign(T* other) {
+		// Take the new reference first, so assigning an object to the
+		// last Ref that holds it does not free it
+		if (other != nullptr)
+			RefIncrement(other);
 		_release();
 		ptr = other;
-		_addRef();
 	}
 public:
 	Ref() : ptr(nullptr) {
 	}
 
-	Ref(T* ptrIn) : ptr(nullptr) {
-		_assign(ptrIn);
+	Ref(T* ptrIn) : ptr(ptrIn) {
+		_addRef();
 	}
 
-	Ref(const Ref<T>& other) : ptr(nullptr) {
-		_assign(other.ptr);
+	Ref(const Ref<T>& other) : ptr(other.ptr) {
+		_addRef();
 	}
 
-	Ref(Ref<T>&& other) : ptr(nullptr) {
-		ptr = other.ptr;
+	Ref(Ref<T>&& other) : ptr(other.ptr) {
 		other.ptr = nullptr;
 	}
 
-	template <typename U> Ref(const Ref<U>& other) : ptr(nullptr) {
-		_assign(other.get());
+	template <typename U> Ref(const Ref<U>& other) : ptr(other.get()) {
+		_addRef();
 	}
 
 	~Ref() {
@@ -61,6 +102,17 @@ public:
 		return (*this);
 	}
 
+	const Ref<T>& operator = (Ref<T>&& other) {
+		Ref<T>(std::move(other)).swap(*this);
+		return (*this);
+	}
+
+	void swap(Ref<T>& other) {
+		T* t = ptr;
+		ptr = other.ptr;
+		other.ptr = t;
+	}
+
 	bool operator ! () const {
 		return ptr == nullptr;
 	}
@@ -90,4 +142,8 @@ public:
 	}
 };
 
+template <typename T> void swap(Ref<T>& a, Ref<T>& b) {
+	a.swap(b);
+}
+
 #endif // __REF_H__
@@ -0,0 +1,131 @@
+#include "Resolver.h"
+
+Resolver::Resolver() {
+	function = nullptr;
+	numSlots = 0;
+	numCallSites = 0;
+}
+
+Resolver::~Resolver() {
+}
+
+void Resolver::_Resolve(ASTNode* node) {
+	assert(node != nullptr);
+	switch (node->Type()) {
+		case AST_FUNC_DEF:
+			// Nested definitions are never executed
+			return;
+		case AST_CALL: {
+			ASTCall* call = (ASTCall*)node;
+			call->SetSite(numCallSites++);
+			for (size_t i = 0; i < call->NumArguments(); ++i)
+				_Resolve(call->Argument(i));
+			return;
+		}
+		case AST_IDENTIFIER:
+			_Resolve((ASTIdentifier*)node);
+			return;
+		case AST_ADD:
+		case AST_SUBTRACT: {
+			// Left operands first as in the default walk, without
+			// recursing down a long chain
+			vector<ASTNode*> chain;
+			ASTNode* term = node;
+			while (term->Type() == AST_ADD || term->Type() == AST_SUBTRACT) {
+				chain.push_back(term);
+				term = term->Child(0);
+			}
+
+			_Resolve(term);
+			for (size_t i = chain.size(); i > 0; --i)
+				_Resolve(chain[i - 1]->Child(1));
+			return;
+		}
+		default:
+			break;
+	}
+
+	for (size_t i = 0; i < node->NumChildren(); ++i)
+		_Resolve(node->Child(i));
+}
+
+void Resolver::_Resolve(ASTIdentifier* node) {
+	string name = node->Name();
+
+	Ref<Symbol> sym = nullptr;
+	if (function != nullptr && function->IsParameter(name))
+		sym = function->Resolve(name);
+	else
+		sym = scope->ResolveLocal(name);
+
+	if (!sym) {
+		sym = new VariableSymbol(name, numSlots++);
+		scope->Define(sym);
+	}
+
+	assert(sym->Type() == ST_VARIABLE);
+	int slot = ((VariableSymbol*)sym.get())->Slot();
+
+	int globalSlot = -1;
+	if (function != nullptr) {
+		Ref<Symbol> g = global->ResolveLocal(name);
+		if (g != nullptr && g->Type() == ST_VARIABLE)
+			globalSlot = ((VariableSymbol*)g.get())->Slot();
+	}
+
+	node->Resolve(slot, globalSlot);
+}
+
+void Resolver::_ResolveFunction(ASTFuncDef* node) {
+	Ref<FunctionSymbol> fn = new FunctionSymbol(node->Name());
+
+	// Variables and functions do not share a namespace at runtime,
+	// so a clashing name keeps the symbol defined first
+	if (global->ResolveLocal(node->Name()) == nullptr)
+		global->Define(fn);
+
+	// Parameters take the first slots so arguments can be passed in place
+	numSlots = 0;
+	for (size_t i = 0; i < node->NumParameters(); ++i) {
+		ASTParameter* param = node->Parameter(i);
+		param->SetSlot(numSlots);
+		if (!fn->IsParameter(param->Name()))
+			fn->Define(new VariableSymbol(param->Name(), numSlots));
+		numSlots++;
+	}
+
+	function = fn.get();
+	scope = fn->Inner();
+	_Resolve(node->Block());
+	node->SetNumSlots(numSlots);
+
+	function = nullptr;
+	scope = global;
+}
+
+Ref<Scope> Resolver::Resolve(ASTProgram* program) {
+	assert(program != nullptr);
+	global = new Scope();
+	scope = global;
+	function = nullptr;
+	numSlots = 0;
+	numCallSites = 0;
+
+	// Globals first, functions fall back on them
+	for (size_t i = 0; i < program->NumChildren(); ++i) {
+		if (program->Child(i)->Type() != AST_FUNC_DEF)
+			_Resolve(program->Child(i));
+	}
+	program->SetNumSlots(numSlots);
+
+	for (size_t i = 0; i < program->NumChildren(); ++i) {
+		if (program->Child(i)->Type() == AST_FUNC_DEF)
+			_ResolveFunction((ASTFuncDef*)program->Child(i));
+	}
+	program->SetNumCallSites(numCallSites);
+
+	Ref<Scope> result = global;
+	global = nullptr;
+	scope = nullptr;
+	return result;
+}
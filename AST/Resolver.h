@@ -0,0 +1,30 @@
+#ifndef __RESOLVER_H__
+#define __RESOLVER_H__
+
+#include "Common.h"
+#include "AST.h"
+#include "Symbol.h"
+
+// Assigns every variable a slot in the frame of the function it is used
+// in. Names used at the top level live in the global frame, which a
+// function falls back to while its own slot is undefined.
+class Resolver {
+private:
+	Ref<Scope>				global;
+	Ref<Scope>				scope;
+	FunctionSymbol*			function;
+	int						numSlots;
+	int						numCallSites;
+private:
+	void					_Resolve(ASTNode* node);
+	void					_Resolve(ASTIdentifier* node);
+	void					_ResolveFunction(ASTFuncDef* node);
+public:
+							Resolver();
+							~Resolver();
+
+	// Annotate the program, returns the global scope
+	Ref<Scope>				Resolve(ASTProgram* program);
+};
+
+#endif // __RESOLVER_H__
@@ -0,0 +1,42 @@
+#include "Source.h"
+#include <cstring>
+
+Source::Source(const char* str) {
+	assert(str != nullptr);
+	text.assign(str, strlen(str));
+}
+
+Source::Source(const char* str, size_t length) {
+	assert(str != nullptr);
+	text.assign(str, length);
+}
+
+Source::Source(const MappedFileRef& mapped) : file(mapped) {
+	assert(file != nullptr);
+}
+
+Source::~Source() {
+}
+
+const char* Source::Data() const {
+	if (file == nullptr)
+		return text.data();
+	// An empty file has no view
+	return (file->Data() != nullptr) ? file->Data() : "";
+}
+
+size_t Source::Length() const {
+	return (file != nullptr) ? file->Length() : text.size();
+}
+
+string Source::Text(size_t offset, size_t length) const {
+	assert(offset + length <= Length());
+	return string(Data() + offset, length);
+}
+
+SourceRef ReadSource(const string& fileName) {
+	MappedFileRef file = new MappedFile();
+	if (!file->Open(fileName))
+		return nullptr;
+	return new Source(file);
+}
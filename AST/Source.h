@@ -0,0 +1,33 @@
+#ifndef __SOURCE_H__
+#define __SOURCE_H__
+
+#include "Common.h"
+#include "Ref.h"
+#include "MappedFile.h"
+
+// Script text being parsed. Tokens refer into it by offset, so it is
+// shared by the lexer, the parser and the parse result. The text is a
+// copy, or a file mapped where it lies, which is kept mapped for as
+// long as the Source lives. Either way it is read by length and need
+// not end in a NUL.
+class Source : public virtual RefObject {
+private:
+	string			text;
+	MappedFileRef	file;
+public:
+					Source(const char* text);
+					Source(const char* text, size_t length);
+					Source(const MappedFileRef& file);
+					~Source();
+
+	const char*		Data() const;
+	size_t			Length() const;
+	string			Text(size_t offset, size_t length) const;
+};
+
+typedef Ref<Source> SourceRef;
+
+// Maps the named file, null when it cannot be opened
+SourceRef ReadSource(const string& fileName);
+
+#endif // __SOURCE_H__
@@ -53,6 +53,10 @@ Ref<Scope> FunctionSymbol::Inner() {
 	return inner;
 }
 
+size_t FunctionSymbol::NumParameters() const {
+	return parameters.size();
+}
+
 bool FunctionSymbol::IsParameter(const string& name) {
 	for (size_t i = 0; i < parameters.size(); ++i) {
 		if (parameters[i]->Name() == name) {
@@ -63,8 +67,16 @@ bool FunctionSymbol::IsParameter(const string& name) {
 }
 
 VariableSymbol::VariableSymbol(string name) :
-	Symbol(name,ST_VARIABLE){
+	Symbol(name,ST_VARIABLE), slot(-1) {
+}
+
+VariableSymbol::VariableSymbol(string name, int s) :
+	Symbol(name,ST_VARIABLE), slot(s) {
 }
 
 VariableSymbol::~VariableSymbol() {
 }
+
+int VariableSymbol::Slot() const {
+	return slot;
+}
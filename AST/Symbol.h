@@ -44,6 +44,7 @@ public:
 	IScope*						Enclosing()					override;
 	void						Define(Ref<Symbol> sym)		override;
 	Ref<Symbol>					Resolve(const string& name)	override;
+	Ref<Symbol>					ResolveLocal(const string& name);
 
 	void						Attach(Ref<Scope>& child);
 	size_t						NumChildren() const;
@@ -51,9 +52,14 @@ public:
 };
 
 class VariableSymbol : public Symbol {
+protected:
+	int							slot;
 public:
 								VariableSymbol(string name);
+								VariableSymbol(string name, int slot);
 								~VariableSymbol();
+
+	int							Slot() const;
 };
 
 class FunctionSymbol : public IScope, public Symbol {
@@ -71,6 +77,7 @@ public:
 	Ref<Symbol>					Resolve(const string& name)	override;
 
 	bool						IsParameter(const string& name);
+	size_t						NumParameters() const;
 	Ref<Scope>					Inner();
 };
 
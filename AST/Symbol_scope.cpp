@@ -26,12 +26,21 @@ void Scope::Define(Ref<Symbol> sym) {
 
 Ref<Symbol> Scope::Resolve(const string& name) {
 	Ref<Symbol>* stored = symbols.Get(name);
-	if (stored == nullptr && enclosing != nullptr) {
-		return enclosing->Resolve(name);
+	if (stored == nullptr) {
+		if (enclosing != nullptr)
+			return enclosing->Resolve(name);
+		return nullptr;
 	}
 	return *stored;
 }
 
+Ref<Symbol> Scope::ResolveLocal(const string& name) {
+	Ref<Symbol>* stored = symbols.Get(name);
+	if (stored == nullptr)
+		return nullptr;
+	return *stored;
+}
+
 void Scope::Attach(Ref<Scope>& child) {
 	for (size_t i = 0; i < children.size(); ++i) {
 		assert(children[i] != child.get());